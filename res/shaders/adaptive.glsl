@@ -0,0 +1,27 @@
+// Active pixel list shared by the adaptive sampling passes (rt_adaptive*.comp), keep in sync with Adaptive.h
+
+#define ADAPTIVE_GROUP_SIZE 64
+
+layout (std430, binding = 24) buffer activeSSBO {
+	uint activeCount;
+	uint activePad[3];
+	uvec3 dispatchSize; // glDispatchComputeIndirect arguments for the trace pass, at byte offset 16
+	uint dispatchPad;
+	uint activePixels[]; // x in the low 16 bits, from byte offset 32
+};
+
+uniform float targetError; // Relative standard error of the mean luminance a pixel stops at
+uniform int minSamples; // Below this the variance estimate isn't trusted
+
+// Standard error of the pixel's mean luminance relative to that mean. The small constant in the
+// denominator keeps near-black pixels from needing unbounded samples to hit a relative target.
+bool PixelConverged(in ivec2 pixel) {
+	if (currAccumPass == 1) return false; // Accumulation is being reset, the images hold the previous view
+
+	const vec4 accumulated = imageLoad(accumImage, pixel);
+	if (accumulated.a < float(minSamples)) return false;
+
+	const float mean = Luminance(accumulated.rgb);
+	const float variance = max(imageLoad(momentsImage, pixel).r - mean * mean, 0.0);
+	return sqrt(variance / accumulated.a) <= targetError * (mean + 0.01);
+}
@@ -0,0 +1,97 @@
+// Per-pixel sampler, included by trace.glsl. A path's state holds the pixel hash and, in its low
+// byte, the next dimension to draw. Each pixel's samples are an Owen-scrambled Sobol sequence
+// indexed by firstSample + subSample; dimensions come in (0,2) pairs, each pair with its own shuffle of the
+// sample index. https://jcgt.org/published/0009/04/01/
+// SOBOL_SAMPLER 0 switches to independent PCG numbers for comparison.
+
+#ifndef SOBOL_SAMPLER
+#define SOBOL_SAMPLER 1
+#endif
+
+uniform int firstSample; // Samples taken per pixel before this dispatch since the accumulation was reset
+int subSample = 0; // Sample within the dispatch when a pass takes several
+
+#define DIMENSIONS_PER_BOUNCE 12 // Even, so the 2D draws of a bounce stay on pair boundaries
+#define CAMERA_DIMENSIONS 2
+
+// The dimension lives in the low byte of the state, deeper paths would wrap around onto the camera dimensions
+#if CAMERA_DIMENSIONS + MAX_BOUNCES * DIMENSIONS_PER_BOUNCE > 256
+#error MAX_BOUNCES needs more sampler dimensions than the 8-bit dimension field holds
+#endif
+
+// https://www.jcgt.org/published/0009/03/02/
+uint HashUint(in uint x) {
+	uint state = x * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+uint HashCombine(in uint seed, in uint value) {
+	return HashUint(seed ^ (value + 0x9e3779b9u + (seed << 6u) + (seed >> 2u)));
+}
+
+uint NextRandom(inout uint state) {
+	state = state * 747796405u + 2891336453u;
+	uint result = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	result = (result >> 22u) ^ result;
+	return result;
+}
+
+// Owen scrambling as a hash on reversed bits, Burley's variant of Laine-Karras
+uint NestedUniformScramble(in uint x, in uint seed) {
+	x = bitfieldReverse(x);
+	x ^= x * 0x3d20adeau;
+	x += seed;
+	x *= (seed >> 16u) | 1u;
+	x ^= x * 0x05526c56u;
+	x ^= x * 0x53a22864u;
+	return bitfieldReverse(x);
+}
+
+// Second Sobol dimension, the first is bitfieldReverse(index)
+uint SobolSecond(in uint index) {
+	uint result = 0u;
+	for (uint v = 1u << 31u; index != 0u; index >>= 1u, v ^= v >> 1u) {
+		if ((index & 1u) != 0u) result ^= v;
+	}
+	return result;
+}
+
+// State for the current sample of a pixel, starts at dimension 0
+uint BeginSample(in ivec2 pixel) {
+	const uint pixelHash = HashCombine(HashUint(uint(pixel.x)), uint(pixel.y));
+#if SOBOL_SAMPLER
+	return pixelHash & ~0xFFu;
+#else
+	return HashCombine(pixelHash, uint(firstSample + subSample));
+#endif
+}
+
+// Jumps to a dimension, so every bounce draws its decisions from the same dimensions whatever
+// earlier bounces used
+void SetSampleDimension(inout uint state, in int dimension) {
+#if SOBOL_SAMPLER
+	state = (state & ~0xFFu) | (uint(dimension) & 0xFFu);
+#endif
+}
+
+// First dimension of a bounce, dimensions 0 and 1 are the pixel jitter
+int BounceDimension(in int bounce) {
+	return CAMERA_DIMENSIONS + bounce * DIMENSIONS_PER_BOUNCE;
+}
+
+// Uniform in [0, 1)
+float RandomValue(inout uint state) {
+#if SOBOL_SAMPLER
+	const uint dimension = state & 0xFFu;
+	const uint pixelHash = state & ~0xFFu;
+	state = pixelHash | ((dimension + 1u) & 0xFFu);
+
+	const uint pairSeed = HashCombine(pixelHash, dimension >> 1u);
+	const uint index = NestedUniformScramble(uint(firstSample + subSample), pairSeed);
+	const uint sobol = (dimension & 1u) == 0u ? bitfieldReverse(index) : SobolSecond(index);
+	return float(NestedUniformScramble(sobol, HashCombine(pairSeed, dimension & 1u)) >> 8u) / 16777216.0;
+#else
+	return float(NextRandom(state) >> 8u) / 16777216.0;
+#endif
+}
@@ -0,0 +1,1066 @@
+// Shared by rt.comp and the wavefront passes, included right after #version
+
+#extension GL_KHR_shader_subgroup_arithmetic : enable
+
+layout (rgba32f, binding = 0) uniform image2D accumImage;
+layout (r32f, binding = 1) uniform image2D momentsImage; // Mean squared luminance, with accumImage it gives the per-pixel variance
+
+#define PI 3.14159265359
+#define TWO_PI 6.28318530718
+#define INFINITY 10000000.0
+#define HIT_LIMIT 0.00001
+
+// Leaf entries in primRefs, keep in sync with PrimType in BVH.h
+#define PRIM_TRIANGLE 0
+#define PRIM_BOX 1
+#define PRIM_DISC 2
+#define PRIM_QUAD 3
+#define PRIM_TYPE_SHIFT 28
+#define PRIM_INDEX_MASK 0x0FFFFFFF
+
+// HitRecord::primType besides the PRIM_ types above
+#define HIT_NONE (-1)
+#define HIT_SPHERE 4
+#define HIT_PLANE 5
+
+// Keep in sync with MeshFlags and PageFeedback in Object.h
+#define LIGHT_TRIANGLE 0
+#define LIGHT_SPHERE 1
+
+#define MESH_PAGE 1
+#define PAGE_USED 1u
+#define PAGE_REQUESTED 2u
+
+// Compile-time features, ComputeProgram variants define them from Scene::FeatureDefines, a program
+// built without defines gets every feature
+#ifndef MAX_BOUNCES
+#define MAX_BOUNCES 8
+#endif
+#ifndef DEBUG_NORMAL
+#define DEBUG_NORMAL 0
+#endif
+#ifndef HAS_TRIANGLES
+#define HAS_TRIANGLES 1
+#endif
+#ifndef HAS_QUADS
+#define HAS_QUADS 1
+#endif
+#ifndef HAS_BOXES
+#define HAS_BOXES 1
+#endif
+#ifndef HAS_DISCS
+#define HAS_DISCS 1
+#endif
+#ifndef HAS_SPHERES
+#define HAS_SPHERES 1
+#endif
+#ifndef HAS_PLANES
+#define HAS_PLANES 1
+#endif
+#ifndef HAS_SPECULAR
+#define HAS_SPECULAR 1
+#endif
+#ifndef HAS_REFRACTION
+#define HAS_REFRACTION 1
+#endif
+#ifndef HAS_LIGHTS
+#define HAS_LIGHTS 1
+#endif
+
+const bool hasTriangles = HAS_TRIANGLES != 0;
+const bool hasQuads = HAS_QUADS != 0;
+const bool hasBoxes = HAS_BOXES != 0;
+const bool hasDiscs = HAS_DISCS != 0;
+const bool hasSpheres = HAS_SPHERES != 0;
+const bool hasPlanes = HAS_PLANES != 0;
+const bool hasSpecular = HAS_SPECULAR != 0; // Any material with specularChance
+const bool hasRefraction = HAS_REFRACTION != 0; // Any material with refractionAmount
+const bool hasLights = HAS_LIGHTS != 0; // Next-event estimation
+
+// Only meaningful in passes that run one invocation per pixel
+const ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy);
+
+const vec2 accumTexSize = imageSize(accumImage);
+
+uniform int currAccumPass;
+uniform int samplesPerPass = 1; // Samples per pixel per dispatch, summed before the accumulation image is touched
+
+const bool debugNormal = DEBUG_NORMAL != 0;
+
+const int maxBounces = MAX_BOUNCES; // Hard cap, Russian roulette usually ends paths sooner
+const int rouletteDepth = 3; // Bounces every path gets before Russian roulette starts
+
+const vec3 skyColor = vec3(1.0);
+const float skyIntensity = 0.5;
+
+struct Ray { vec3 origin; vec3 direction; };
+struct Camera {
+	vec3 position;
+	mat4 inverseView;
+};
+struct Material {
+	vec4 baseColor;
+	vec4 specularColor;
+	vec4 emissionColor;
+    float smoothness;
+    float specularSmoothness;
+	float emissionStrength;
+	float ior;
+	float refractionAmount;
+	float specularChance;
+	int maxDepth; // Paths end at this bounce count when they hit the material, 0 for no override
+	/* + 4 bytes of padding */
+};
+struct Sphere { vec3 position; float radius; uint materialIndex; /* + 12 bytes of padding */};
+struct Triangle { vec4 vertex; vec4 edge1; vec4 edge2; }; // PrecomputedTriangle, material index in the bits of vertex.w
+struct Plane { vec3 normal; float offset; uint materialIndex; /* + 12 bytes of padding */ };
+struct Box { vec4 boundsMin; vec4 boundsMax; uint materialIndex; /* + 12 bytes of padding */ };
+struct Disc { vec3 position; float radius; vec3 normal; uint materialIndex; };
+struct Quad { vec4 p1; vec4 p2; vec4 p3; vec4 p4; uint materialIndex; /* + 12 bytes of padding */ };
+struct HitInfo { vec3 hitPoint; vec3 hitNormal; float hitDist; float travelDist; bool hasHit; bool frontFace; Material hitMaterial; int primType; int primIndex; };
+struct HitRecord { float t; int primType; int primIndex; vec2 uv; }; // primIndex includes the pool offsets
+struct Node { vec4 boundsMin; vec4 boundsMax; int triIndex; int numTris; int childrenIndex; int leafBlock; };
+struct MeshRecord { int rootIndex; int primRefOffset; int triOffset; int quadOffset; int leafBlockOffset; int flags; };
+struct Light { vec4 position; vec4 edge1; vec4 edge2; vec3 radiance; float aliasProbability; int type; int alias; float selectionPdf; /* + 4 bytes of padding */ };
+
+uniform Camera cam;
+
+layout (std430, binding = 1) readonly buffer primRefSSBO {
+	int primRefs[];
+};
+layout (std430, binding = 2) readonly buffer bvhSSBO {
+	Node nodes[];
+};
+layout (std430, binding = 3) readonly buffer materialSSBO {
+	Material sceneMaterials[];
+};
+layout (std430, binding = 4) readonly buffer sphereSSBO {
+	Sphere sceneSpheres[];
+};
+layout (std430, binding = 5) readonly buffer triangleSSBO {
+	Triangle sceneTriangles[];
+};
+layout (std430, binding = 6) readonly buffer planeSSBO {
+	Plane scenePlanes[];
+};
+layout (std430, binding = 7) readonly buffer boxSSBO {
+	Box sceneBoxes[];
+};
+layout (std430, binding = 8) readonly buffer discSSBO {
+	Disc sceneDiscs[];
+};
+layout (std430, binding = 9) readonly buffer quadSSBO {
+	Quad sceneQuads[];
+};
+layout (std430, binding = 10) readonly buffer meshRecordSSBO {
+	int topLevelRoot; // Tree over the root bounds of every traced mesh, -1 without meshes, see GeometryPool::BuildTopLevel
+	int topLevelPad[3];
+	MeshRecord meshRecords[];
+};
+layout (std430, binding = 11) readonly buffer leafBlockSSBO {
+	uint leafBlocks[];
+};
+layout (std430, binding = 12) readonly buffer pageTableSSBO {
+	int pageTable[]; // Mesh record of each page, -1 if not resident
+};
+layout (std430, binding = 13) buffer pageFeedbackSSBO {
+	uint pageFeedback[]; // PAGE_USED | PAGE_REQUESTED per page, copied out and cleared by ResidencyManager::Update
+};
+
+layout (std430, binding = 23) readonly buffer lightSSBO {
+	float lightPower; // Sum of luminance times area over all lights
+	Light lights[]; // Emissive triangles and spheres with an alias table over their power
+};
+
+layout (std430, binding = 22) buffer pathStatsSSBO {
+	uint finishedPaths; // Read back and cleared by Renderer::ReadAveragePathLength
+	uint totalBounces;
+};
+
+// Nearest point where a ray entered a page that isn't resident, a hit beyond it can't be trusted
+float deferDist = INFINITY;
+bool sampleDeferred = false;
+
+#include "sampler.glsl"
+
+// https://graphics.pixar.com/library/OrthonormalB/paper.pdf
+void OrthonormalBasis(in vec3 n, out vec3 tangent, out vec3 bitangent) {
+	const float s = n.z >= 0.0 ? 1.0 : -1.0;
+	const float a = -1.0 / (s + n.z);
+	const float b = n.x * n.y * a;
+	tangent = vec3(1.0 + s * n.x * n.x * a, s * b, -s * n.x);
+	bitangent = vec3(b, s + n.y * n.y * a, -n.y);
+}
+
+// Uniform on the sphere, two uniform numbers instead of three Gaussian ones
+vec3 RandomDirection(inout uint state) {
+	const float z = 1.0 - 2.0 * RandomValue(state);
+	const float r = sqrt(max(1.0 - z * z, 0.0));
+	const float phi = TWO_PI * RandomValue(state);
+	return vec3(r * cos(phi), r * sin(phi), z);
+}
+
+// Cosine weighted around z, pdf is z / PI
+vec3 CosineDirectionLocal(inout uint state) {
+	const float u = RandomValue(state);
+	const float r = sqrt(u);
+	const float phi = TWO_PI * RandomValue(state);
+	return vec3(r * cos(phi), r * sin(phi), sqrt(max(1.0 - u, 0.0)));
+}
+
+// GGX distribution of visible normals, view direction and the returned half vector are in the local
+// frame of the normal. https://jcgt.org/published/0007/04/01/
+vec3 SampleGGXVNDF(in vec3 view, in float alpha, inout uint state) {
+	const vec3 stretched = normalize(vec3(alpha * view.x, alpha * view.y, view.z));
+	const float lengthSq = stretched.x * stretched.x + stretched.y * stretched.y;
+	const vec3 t1 = lengthSq > 0.0 ? vec3(-stretched.y, stretched.x, 0.0) * inversesqrt(lengthSq) : vec3(1.0, 0.0, 0.0);
+	const vec3 t2 = cross(stretched, t1);
+
+	const float r = sqrt(RandomValue(state));
+	const float phi = TWO_PI * RandomValue(state);
+	const float p1 = r * cos(phi);
+	const float s = 0.5 * (1.0 + stretched.z);
+	const float p2 = (1.0 - s) * sqrt(1.0 - p1 * p1) + s * r * sin(phi);
+
+	const vec3 normal = p1 * t1 + p2 * t2 + sqrt(max(1.0 - p1 * p1 - p2 * p2, 0.0)) * stretched;
+	return normalize(vec3(alpha * normal.x, alpha * normal.y, max(normal.z, 0.0)));
+}
+
+// Smith masking term of GGX for a direction at cosTheta to the normal
+float SmithLambda(in float alpha, in float cosTheta) {
+	const float cos2 = max(cosTheta * cosTheta, 1e-8);
+	return 0.5 * (-1.0 + sqrt(1.0 + alpha * alpha * (1.0 - cos2) / cos2));
+}
+
+float Luminance(in vec3 color) {
+	return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+float LengthSquared(in vec3 vec) {
+	return (vec.x * vec.x + vec.y * vec.y + vec.z * vec.z);
+}
+
+// https://tavianator.com/2011/ray_box.html
+// Boxes entered beyond maxDist can't hold anything closer than what was already found
+bool HitAABB(in vec3 boundsMin, in vec3 boundsMax, in Ray ray, in float maxDist) {
+	vec3 invDir = (1.0/ray.direction);
+
+	float tx1 = (boundsMin.x - ray.origin.x)*invDir.x;
+	float tx2 = (boundsMax.x - ray.origin.x)*invDir.x;
+
+	float tMin = min(tx1, tx2);
+	float tMax = max(tx1, tx2);
+
+	float ty1 = (boundsMin.y - ray.origin.y)*invDir.y;
+	float ty2 = (boundsMax.y - ray.origin.y)*invDir.y;
+
+	tMin = max(tMin, min(ty1, ty2));
+	tMax = min(tMax, max(ty1, ty2));
+
+	float tz1 = (boundsMin.z - ray.origin.z)*invDir.z;
+	float tz2 = (boundsMax.z - ray.origin.z)*invDir.z;
+
+	tMin = max(tMin, min(tz1, tz2));
+	tMax = min(tMax, max(tz1, tz2));
+
+	return tMax >= tMin && tMax >= 0 && tMin < maxDist;
+};
+
+bool HitAABB(in vec3 boundsMin, in vec3 boundsMax, in Ray ray) {
+	return HitAABB(boundsMin, boundsMax, ray, INFINITY);
+}
+
+// Distance at which the ray enters the box, only called once the box is known to be hit
+float EntryDistAABB(in vec3 boundsMin, in vec3 boundsMax, in Ray ray) {
+	vec3 invDir = 1.0 / ray.direction;
+	vec3 t1 = (boundsMin - ray.origin) * invDir;
+	vec3 t2 = (boundsMax - ray.origin) * invDir;
+	vec3 tMin = min(t1, t2);
+	return max(max(max(tMin.x, tMin.y), tMin.z), 0.0);
+}
+
+// The intersection tests only find the distance (and the surface coordinates where shading needs
+// them). Each returns true and updates t for a hit closer than t, ResolveHit builds the shading
+// data once for the closest hit.
+
+bool IntersectSphere(in Sphere sphere, in Ray ray, inout float t) {
+	vec3 oc = ray.origin - sphere.position;
+	float a = dot(ray.direction, ray.direction);
+	float halfB = dot(oc, ray.direction);
+	float c = dot(oc, oc) - sphere.radius * sphere.radius;
+
+	float discriminant = halfB * halfB - a * c;
+	if (discriminant < 0.0) return false;
+
+	float sqrtDisc = sqrt(discriminant);
+	float t0 = (-halfB - sqrtDisc) / a;
+	float t1 = (-halfB + sqrtDisc) / a;
+
+	float hitDist = t0 > HIT_LIMIT ? t0 : t1; // From inside only the far side is hit
+	if (hitDist <= HIT_LIMIT || hitDist >= t) return false;
+
+	t = hitDist;
+	return true;
+}
+
+// https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm
+// Bails out as soon as a barycentric test fails. slack widens the barycentric bounds, compressed
+// leaves use it to cover quantization error.
+bool IntersectTriangle(in Triangle tri, in Ray ray, in float slack, inout float t, inout vec2 uv) {
+	vec3 rayCrossE2 = cross(ray.direction, tri.edge2.xyz);
+	float det = dot(tri.edge1.xyz, rayCrossE2);
+	if (det == 0.0) return false;
+
+	float invDet = 1.0 / det;
+	vec3 s = ray.origin - tri.vertex.xyz;
+	float u = invDet * dot(s, rayCrossE2);
+	if (u < -slack || u > 1 + slack) return false;
+
+	vec3 sCrossE1 = cross(s, tri.edge1.xyz);
+	float v = invDet * dot(ray.direction, sCrossE1);
+	if (v < -slack || u + v > 1 + slack) return false;
+
+	float hitDist = invDet * dot(tri.edge2.xyz, sCrossE1);
+	if (hitDist <= HIT_LIMIT || hitDist >= t) return false;
+
+	t = hitDist;
+	uv = vec2(u, v);
+	return true;
+}
+
+bool IntersectPlane(in Plane plane, in Ray ray, inout float t) {
+	float denom = dot(plane.normal, ray.direction);
+	if (denom == 0.0) return false;
+
+	float hitDist = (plane.offset - dot(plane.normal, ray.origin)) / denom;
+	if (hitDist <= HIT_LIMIT || hitDist >= t) return false;
+
+	t = hitDist;
+	return true;
+}
+
+// Slab test, entering from outside or leaving from inside the box
+bool IntersectBox(in Box box, in Ray ray, inout float t) {
+	vec3 invDir = 1.0 / ray.direction;
+	vec3 t1 = (box.boundsMin.xyz - ray.origin) * invDir;
+	vec3 t2 = (box.boundsMax.xyz - ray.origin) * invDir;
+	vec3 tMin = min(t1, t2);
+	vec3 tMax = max(t1, t2);
+
+	float tNear = max(max(tMin.x, tMin.y), tMin.z);
+	float tFar = min(min(tMax.x, tMax.y), tMax.z);
+	if (tFar < tNear || tFar <= HIT_LIMIT) return false;
+
+	float hitDist = tNear > HIT_LIMIT ? tNear : tFar;
+	if (hitDist >= t) return false;
+
+	t = hitDist;
+	return true;
+}
+
+bool IntersectDisc(in Disc disc, in Ray ray, inout float t) {
+	float denom = dot(disc.normal, ray.direction);
+	if (denom == 0.0) return false;
+
+	float hitDist = dot(disc.position - ray.origin, disc.normal) / denom;
+	if (hitDist <= HIT_LIMIT || hitDist >= t) return false;
+	if (LengthSquared(ray.origin + ray.direction * hitDist - disc.position) > disc.radius * disc.radius) return false;
+
+	t = hitDist;
+	return true;
+}
+
+// Ray / bilinear patch intersection from "Cool Patches" (Reshetov, Ray Tracing Gems ch. 8)
+// Corners p1, p2, p3, p4 are q00, q10, q11, q01 of the patch
+bool IntersectQuad(in Quad quad, in Ray ray, inout float t, inout vec2 uv) {
+	vec3 q00 = quad.p1.xyz, q10 = quad.p2.xyz, q11 = quad.p3.xyz, q01 = quad.p4.xyz;
+	vec3 e10 = q10 - q00;
+	vec3 e11 = q11 - q10;
+	vec3 e00 = q01 - q00;
+	vec3 qn = cross(e10, q01 - q11);
+	q00 -= ray.origin;
+	q10 -= ray.origin;
+
+	// Quadratic in u: a + b u + c u^2 = 0
+	float a = dot(cross(q00, ray.direction), e00);
+	float c = dot(qn, ray.direction);
+	float b = dot(cross(q10, ray.direction), e11) - (a + c);
+	float det = b * b - 4.0 * a * c;
+	if (det < 0.0) return false;
+	det = sqrt(det);
+
+	float u1, u2;
+	if (c == 0.0) { u1 = -a / b; u2 = -1.0; } // Planar, so there is only one root
+	else { u1 = (-b - (b < 0.0 ? -det : det)) / 2.0; u2 = a / u1; u1 /= c; }
+
+	bool hit = false;
+	for (int i = 0; i < 2; ++i) {
+		float uRoot = i == 0 ? u1 : u2;
+		if (uRoot < 0.0 || uRoot > 1.0) continue;
+
+		vec3 pa = mix(q00, q10, uRoot);
+		vec3 pb = mix(e00, e11, uRoot);
+		vec3 n = cross(ray.direction, pb);
+		float nLen2 = dot(n, n);
+		n = cross(n, pa);
+		float tRoot = dot(n, pb) / nLen2;
+		float vRoot = dot(n, ray.direction);
+
+		if (vRoot >= 0.0 && vRoot <= nLen2 && tRoot > HIT_LIMIT && tRoot < t) {
+			t = tRoot;
+			uv = vec2(uRoot, vRoot / nLen2);
+			hit = true;
+		}
+	}
+	return hit;
+}
+
+// Shading data for the closest hit, fetched once per bounce
+HitInfo ResolveHit(in HitRecord hit, in Ray ray) {
+	HitInfo hitInfo;
+	hitInfo.hasHit = hit.primType != HIT_NONE;
+	hitInfo.hitDist = hit.t;
+	hitInfo.travelDist = 0.0;
+	hitInfo.primType = hit.primType;
+	hitInfo.primIndex = hit.primIndex;
+	if (!hitInfo.hasHit) return hitInfo;
+
+	hitInfo.hitPoint = ray.origin + ray.direction * hit.t;
+
+	vec3 normal; // Geometric normal, flipped to face the ray below
+	uint materialIndex;
+
+	if (hit.primType == PRIM_TRIANGLE) {
+		Triangle tri = sceneTriangles[hit.primIndex];
+		normal = normalize(cross(tri.edge1.xyz, tri.edge2.xyz));
+		materialIndex = floatBitsToUint(tri.vertex.w);
+	} else if (hit.primType == PRIM_QUAD) {
+		// Patch normal from the partial derivatives at (u, v)
+		Quad quad = sceneQuads[hit.primIndex];
+		vec3 du = mix(quad.p2.xyz - quad.p1.xyz, quad.p3.xyz - quad.p4.xyz, hit.uv.y);
+		vec3 dv = mix(quad.p4.xyz - quad.p1.xyz, quad.p3.xyz - quad.p2.xyz, hit.uv.x);
+		normal = normalize(cross(du, dv));
+		materialIndex = quad.materialIndex;
+	} else if (hit.primType == PRIM_BOX) {
+		// The face is the slab that was entered, or exited from inside
+		Box box = sceneBoxes[hit.primIndex];
+		vec3 invDir = 1.0 / ray.direction;
+		vec3 t1 = (box.boundsMin.xyz - ray.origin) * invDir;
+		vec3 t2 = (box.boundsMax.xyz - ray.origin) * invDir;
+		vec3 tMin = min(t1, t2);
+		vec3 tMax = max(t1, t2);
+		bool entered = max(max(tMin.x, tMin.y), tMin.z) > HIT_LIMIT;
+		vec3 axis = entered ? step(tMin.yzx, tMin) * step(tMin.zxy, tMin) : step(tMax, tMax.yzx) * step(tMax, tMax.zxy);
+		normal = entered ? -sign(ray.direction) * axis : sign(ray.direction) * axis;
+		hitInfo.travelDist = min(min(tMax.x, tMax.y), tMax.z) - max(max(tMin.x, tMin.y), tMin.z);
+		materialIndex = box.materialIndex;
+	} else if (hit.primType == PRIM_DISC) {
+		Disc disc = sceneDiscs[hit.primIndex];
+		normal = disc.normal;
+		materialIndex = disc.materialIndex;
+	} else if (hit.primType == HIT_SPHERE) {
+		Sphere sphere = sceneSpheres[hit.primIndex];
+		normal = normalize(hitInfo.hitPoint - sphere.position);
+		hitInfo.travelDist = 2.0 * abs(dot(sphere.position - hitInfo.hitPoint, ray.direction)) / dot(ray.direction, ray.direction);
+		materialIndex = sphere.materialIndex;
+	} else {
+		Plane plane = scenePlanes[hit.primIndex];
+		normal = plane.normal;
+		materialIndex = plane.materialIndex;
+	}
+
+	hitInfo.frontFace = dot(normal, ray.direction) < 0.0;
+	hitInfo.hitNormal = hitInfo.frontFace ? normal : -normal;
+	hitInfo.hitMaterial = sceneMaterials[materialIndex];
+	return hitInfo;
+}
+
+uint ReadLeaf16(in int base, in int i) {
+	return (leafBlocks[base + (i >> 1)] >> ((i & 1) * 16)) & 0xFFFFu;
+}
+
+uint ReadLeaf8(in int base, in int i) {
+	return (leafBlocks[base + (i >> 2)] >> ((i & 3) * 8)) & 0xFFu;
+}
+
+vec4 DecodeLeafVertex(in int vertexBase, in uint vertex, in vec3 boundsMin, in vec3 scale) {
+	int i = int(vertex) * 3;
+	return vec4(boundsMin + vec3(ReadLeaf16(vertexBase, i), ReadLeaf16(vertexBase, i + 1), ReadLeaf16(vertexBase, i + 2)) * scale, 0.0);
+}
+
+// Compressed triangles are tested with their decoded vertices but resolved from the pool triangle
+void IntersectLeaf(inout HitRecord hit, in Ray ray, in Node node, in MeshRecord mesh) {
+	if (node.leafBlock >= 0) {
+		// Compressed leaf, see BVH::leafBlocks for the layout
+		int block = mesh.leafBlockOffset + node.leafBlock;
+		int vertexCount = int(leafBlocks[block] & 0xFFu);
+		int triCount = int(leafBlocks[block] >> 8);
+		float slack = uintBitsToFloat(leafBlocks[block + 1]);
+		int vertexBase = block + 2 + triCount;
+		int indexBase = vertexBase + (vertexCount * 3 + 1) / 2;
+		vec3 scale = (node.boundsMax.xyz - node.boundsMin.xyz) / 65535.0;
+
+		for (int j = 0; j < triCount; ++j) {
+			vec4 p1 = DecodeLeafVertex(vertexBase, ReadLeaf8(indexBase, j * 3), node.boundsMin.xyz, scale);
+			vec4 p2 = DecodeLeafVertex(vertexBase, ReadLeaf8(indexBase, j * 3 + 1), node.boundsMin.xyz, scale);
+			vec4 p3 = DecodeLeafVertex(vertexBase, ReadLeaf8(indexBase, j * 3 + 2), node.boundsMin.xyz, scale);
+
+			if (IntersectTriangle(Triangle(p1, p2 - p1, p3 - p1), ray, slack, hit.t, hit.uv)) {
+				hit.primType = PRIM_TRIANGLE;
+				hit.primIndex = mesh.triOffset + int(leafBlocks[block + 2 + j]);
+			}
+		}
+		return;
+	}
+
+	for (int i = mesh.primRefOffset + node.triIndex; i < mesh.primRefOffset + node.triIndex + node.numTris; ++i) {
+		int primType = primRefs[i] >> PRIM_TYPE_SHIFT;
+		int primIndex = primRefs[i] & PRIM_INDEX_MASK;
+
+		bool primHit = false;
+		if (hasTriangles && primType == PRIM_TRIANGLE) primHit = IntersectTriangle(sceneTriangles[mesh.triOffset + primIndex], ray, 0.0, hit.t, hit.uv);
+		else if (hasQuads && primType == PRIM_QUAD) primHit = IntersectQuad(sceneQuads[mesh.quadOffset + primIndex], ray, hit.t, hit.uv);
+		else if (hasBoxes && primType == PRIM_BOX) primHit = IntersectBox(sceneBoxes[primIndex], ray, hit.t);
+		else if (hasDiscs && primType == PRIM_DISC) primHit = IntersectDisc(sceneDiscs[primIndex], ray, hit.t);
+
+		if (primHit) {
+			hit.primType = primType;
+			hit.primIndex = primType == PRIM_TRIANGLE ? mesh.triOffset + primIndex : primType == PRIM_QUAD ? mesh.quadOffset + primIndex : primIndex;
+		}
+	}
+}
+
+// Pages never link to other pages, so this is TraverseBVH without the page handling
+// (GLSL has no recursion)
+void TraversePage(inout HitRecord hit, in Ray ray, in MeshRecord page) {
+	int nodeStack[32];
+	int stackIndex = 0;
+	nodeStack[stackIndex++] = page.rootIndex;
+
+	while (stackIndex > 0) {
+		Node node = nodes[nodeStack[--stackIndex]];
+
+		if (!HitAABB(node.boundsMin.xyz, node.boundsMax.xyz, ray, hit.t)) continue;
+
+		if (node.numTris > 0) {
+			IntersectLeaf(hit, ray, node, page);
+		} else {
+			nodeStack[stackIndex++] = page.rootIndex + node.childrenIndex + 1;
+			nodeStack[stackIndex++] = page.rootIndex + node.childrenIndex;
+		}
+	}
+}
+
+// Node and primitive indices in a mesh BVH are local to the mesh, the record has the pool offsets.
+// In a paged mesh an internal node with a negative childrenIndex links to page -childrenIndex - 1.
+void TraverseBVH(inout HitRecord hit, in Ray ray, in MeshRecord mesh) {
+	int nodeStack[32]; // BVH::maxDepth + 1 is enough
+	int stackIndex = 0;
+	nodeStack[stackIndex++] = mesh.rootIndex;
+
+	while (stackIndex > 0) {
+		Node node = nodes[nodeStack[--stackIndex]];
+
+		if (!HitAABB(node.boundsMin.xyz, node.boundsMax.xyz, ray, hit.t)) continue;
+
+		if (node.numTris > 0) {
+			IntersectLeaf(hit, ray, node, mesh);
+		} else if (node.childrenIndex < 0) {
+			int page = -node.childrenIndex - 1;
+			int record = pageTable[page];
+
+			if (record >= 0) {
+				atomicOr(pageFeedback[page], PAGE_USED);
+				TraversePage(hit, ray, meshRecords[record]);
+			} else {
+				atomicOr(pageFeedback[page], PAGE_REQUESTED);
+				deferDist = min(deferDist, EntryDistAABB(node.boundsMin.xyz, node.boundsMax.xyz, ray));
+			}
+		} else {
+			nodeStack[stackIndex++] = mesh.rootIndex + node.childrenIndex + 1;
+			nodeStack[stackIndex++] = mesh.rootIndex + node.childrenIndex;
+		}
+	}
+}
+
+HitRecord TraceClosest(in Ray ray) {
+	HitRecord hit;
+	hit.t = INFINITY;
+	hit.primType = HIT_NONE;
+	hit.primIndex = 0;
+	hit.uv = vec2(0.0);
+	deferDist = INFINITY;
+
+	// Infinite planes would cover the whole BVH, so they are tested on their own
+	for (int i = 0; hasPlanes && i < scenePlanes.length(); ++i) {
+		if (IntersectPlane(scenePlanes[i], ray, hit.t)) { hit.primType = HIT_PLANE; hit.primIndex = i; }
+	}
+
+	// Every mesh has its own BVH in the geometry pool, the scene's standalone geometry is one of them.
+	// The top-level tree only leads to the meshes whose root bounds the ray reaches.
+	int topStack[32];
+	int topIndex = 0;
+	if (topLevelRoot >= 0) topStack[topIndex++] = topLevelRoot;
+
+	while (topIndex > 0) {
+		Node node = nodes[topStack[--topIndex]];
+
+		if (!HitAABB(node.boundsMin.xyz, node.boundsMax.xyz, ray, hit.t)) continue;
+
+		if (node.numTris > 0) {
+			TraverseBVH(hit, ray, meshRecords[node.triIndex]);
+		} else {
+			topStack[topIndex++] = topLevelRoot + node.childrenIndex + 1;
+			topStack[topIndex++] = topLevelRoot + node.childrenIndex;
+		}
+	}
+
+	for (int i = 0; hasSpheres && i < sceneSpheres.length(); ++i) {
+		if (IntersectSphere(sceneSpheres[i], ray, hit.t)) { hit.primType = HIT_SPHERE; hit.primIndex = i; }
+	}
+
+	// Something closer may be in a missing page, the sample is retried once the page is streamed in
+	if (hit.t > deferDist) sampleDeferred = true;
+
+	return hit;
+}
+
+HitInfo CalculateRay(in Ray ray) {
+	return ResolveHit(TraceClosest(ray), ray);
+}
+
+// Any-hit versions of the above for shadow and visibility rays, they stop at the first hit
+// closer than tMax and never touch the hit record or materials
+
+bool OccludedLeaf(in Ray ray, in float tMax, in Node node, in MeshRecord mesh) {
+	float t = tMax;
+	vec2 uv;
+
+	if (node.leafBlock >= 0) {
+		int block = mesh.leafBlockOffset + node.leafBlock;
+		int vertexCount = int(leafBlocks[block] & 0xFFu);
+		int triCount = int(leafBlocks[block] >> 8);
+		float slack = uintBitsToFloat(leafBlocks[block + 1]);
+		int vertexBase = block + 2 + triCount;
+		int indexBase = vertexBase + (vertexCount * 3 + 1) / 2;
+		vec3 scale = (node.boundsMax.xyz - node.boundsMin.xyz) / 65535.0;
+
+		for (int j = 0; j < triCount; ++j) {
+			vec4 p1 = DecodeLeafVertex(vertexBase, ReadLeaf8(indexBase, j * 3), node.boundsMin.xyz, scale);
+			vec4 p2 = DecodeLeafVertex(vertexBase, ReadLeaf8(indexBase, j * 3 + 1), node.boundsMin.xyz, scale);
+			vec4 p3 = DecodeLeafVertex(vertexBase, ReadLeaf8(indexBase, j * 3 + 2), node.boundsMin.xyz, scale);
+			if (IntersectTriangle(Triangle(p1, p2 - p1, p3 - p1), ray, slack, t, uv)) return true;
+		}
+		return false;
+	}
+
+	for (int i = mesh.primRefOffset + node.triIndex; i < mesh.primRefOffset + node.triIndex + node.numTris; ++i) {
+		int primType = primRefs[i] >> PRIM_TYPE_SHIFT;
+		int primIndex = primRefs[i] & PRIM_INDEX_MASK;
+
+		if (hasTriangles && primType == PRIM_TRIANGLE) { if (IntersectTriangle(sceneTriangles[mesh.triOffset + primIndex], ray, 0.0, t, uv)) return true; }
+		else if (hasQuads && primType == PRIM_QUAD) { if (IntersectQuad(sceneQuads[mesh.quadOffset + primIndex], ray, t, uv)) return true; }
+		else if (hasBoxes && primType == PRIM_BOX) { if (IntersectBox(sceneBoxes[primIndex], ray, t)) return true; }
+		else if (hasDiscs && primType == PRIM_DISC) { if (IntersectDisc(sceneDiscs[primIndex], ray, t)) return true; }
+	}
+	return false;
+}
+
+bool OccludedPage(in Ray ray, in float tMax, in MeshRecord page) {
+	int nodeStack[32];
+	int stackIndex = 0;
+	nodeStack[stackIndex++] = page.rootIndex;
+
+	while (stackIndex > 0) {
+		Node node = nodes[nodeStack[--stackIndex]];
+
+		if (!HitAABB(node.boundsMin.xyz, node.boundsMax.xyz, ray, tMax)) continue;
+
+		if (node.numTris > 0) {
+			if (OccludedLeaf(ray, tMax, node, page)) return true;
+		} else {
+			nodeStack[stackIndex++] = page.rootIndex + node.childrenIndex + 1;
+			nodeStack[stackIndex++] = page.rootIndex + node.childrenIndex;
+		}
+	}
+	return false;
+}
+
+bool OccludedBVH(in Ray ray, in float tMax, in MeshRecord mesh) {
+	int nodeStack[32];
+	int stackIndex = 0;
+	nodeStack[stackIndex++] = mesh.rootIndex;
+
+	while (stackIndex > 0) {
+		Node node = nodes[nodeStack[--stackIndex]];
+
+		if (!HitAABB(node.boundsMin.xyz, node.boundsMax.xyz, ray, tMax)) continue;
+
+		if (node.numTris > 0) {
+			if (OccludedLeaf(ray, tMax, node, mesh)) return true;
+		} else if (node.childrenIndex < 0) {
+			int page = -node.childrenIndex - 1;
+			int record = pageTable[page];
+
+			if (record >= 0) {
+				atomicOr(pageFeedback[page], PAGE_USED);
+				if (OccludedPage(ray, tMax, meshRecords[record])) return true;
+			} else {
+				atomicOr(pageFeedback[page], PAGE_REQUESTED);
+				deferDist = min(deferDist, EntryDistAABB(node.boundsMin.xyz, node.boundsMax.xyz, ray));
+			}
+		} else {
+			nodeStack[stackIndex++] = mesh.rootIndex + node.childrenIndex + 1;
+			nodeStack[stackIndex++] = mesh.rootIndex + node.childrenIndex;
+		}
+	}
+	return false;
+}
+
+// True as soon as anything is hit between tMin and tMax along the ray
+bool Occluded(in Ray ray, in float tMin, in float tMax) {
+	ray.origin += ray.direction * tMin;
+	tMax -= tMin;
+	deferDist = INFINITY;
+
+	float t = tMax;
+	for (int i = 0; hasPlanes && i < scenePlanes.length(); ++i) {
+		if (IntersectPlane(scenePlanes[i], ray, t)) return true;
+	}
+
+	for (int i = 0; hasSpheres && i < sceneSpheres.length(); ++i) {
+		if (IntersectSphere(sceneSpheres[i], ray, t)) return true;
+	}
+
+	int topStack[32];
+	int topIndex = 0;
+	if (topLevelRoot >= 0) topStack[topIndex++] = topLevelRoot;
+
+	while (topIndex > 0) {
+		Node node = nodes[topStack[--topIndex]];
+
+		if (!HitAABB(node.boundsMin.xyz, node.boundsMax.xyz, ray, tMax)) continue;
+
+		if (node.numTris > 0) {
+			if (OccludedBVH(ray, tMax, meshRecords[node.triIndex])) return true;
+		} else {
+			topStack[topIndex++] = topLevelRoot + node.childrenIndex + 1;
+			topStack[topIndex++] = topLevelRoot + node.childrenIndex;
+		}
+	}
+
+	// Unoccluded only holds if no missing page was crossed on the way
+	if (deferDist < tMax) sampleDeferred = true;
+	return false;
+}
+
+// Picks a light by power with the alias table and a direction toward it from origin, triangles are
+// sampled by area and spheres by the cone they cover. pdf is per solid angle, false if nothing was sampled.
+bool SampleLight(in vec3 origin, out vec3 direction, out float dist, out vec3 radiance, out float pdf, inout uint state) {
+	if (!hasLights || lights.length() == 0) return false;
+
+	const float u = RandomValue(state) * float(lights.length());
+	int index = min(int(u), lights.length() - 1);
+	if (fract(u) >= lights[index].aliasProbability) index = lights[index].alias;
+
+	const Light light = lights[index];
+	radiance = light.radiance;
+
+	if (light.type == LIGHT_TRIANGLE) {
+		const float r1 = sqrt(RandomValue(state));
+		const float r2 = RandomValue(state);
+		const vec3 point = light.position.xyz + light.edge1.xyz * (r1 * (1.0 - r2)) + light.edge2.xyz * (r1 * r2);
+
+		const vec3 toLight = point - origin;
+		dist = length(toLight);
+		direction = toLight / dist;
+
+		const vec3 areaNormal = cross(light.edge1.xyz, light.edge2.xyz);
+		const float cosLight = abs(dot(areaNormal, direction)) / length(areaNormal);
+		if (cosLight < 1e-6) return false;
+
+		// Selection pdf over the area is luminance / lightPower, the same for every point of every triangle light
+		pdf = Luminance(radiance) / lightPower * dist * dist / cosLight;
+	} else {
+		const vec3 toCenter = light.position.xyz - origin;
+		const float centerDist2 = dot(toCenter, toCenter);
+		const float radius2 = light.position.w * light.position.w;
+		if (centerDist2 <= radius2) return false;
+
+		const float cosMax = sqrt(1.0 - radius2 / centerDist2);
+		const float cosTheta = mix(1.0, cosMax, RandomValue(state));
+		const float sinTheta = sqrt(max(1.0 - cosTheta * cosTheta, 0.0));
+		const float phi = TWO_PI * RandomValue(state);
+
+		const vec3 axis = toCenter / sqrt(centerDist2);
+		vec3 tangent, bitangent;
+		OrthonormalBasis(axis, tangent, bitangent);
+		direction = normalize(axis * cosTheta + (tangent * cos(phi) + bitangent * sin(phi)) * sinTheta);
+
+		// Near side of the sphere along the direction
+		const float b = dot(toCenter, direction);
+		dist = b - sqrt(max(b * b - centerDist2 + radius2, 0.0));
+
+		pdf = light.selectionPdf / (TWO_PI * (1.0 - cosMax));
+	}
+	return pdf > 0.0;
+}
+
+// Solid angle pdf of SampleLight producing the direction of ray toward the emitter it hit, 0 for
+// emitters that aren't in the light list
+float LightPdf(in HitInfo hitInfo, in Ray ray) {
+	if (!hasLights || lights.length() == 0) return 0.0;
+
+	const float luminance = Luminance(hitInfo.hitMaterial.emissionColor.rgb * hitInfo.hitMaterial.emissionStrength);
+
+	if (hitInfo.primType == PRIM_TRIANGLE) {
+		const float cosLight = abs(dot(hitInfo.hitNormal, ray.direction));
+		return luminance / lightPower * hitInfo.hitDist * hitInfo.hitDist / max(cosLight, 1e-6);
+	}
+	if (hitInfo.primType == HIT_SPHERE) {
+		const Sphere sphere = sceneSpheres[hitInfo.primIndex];
+		const float radius2 = sphere.radius * sphere.radius;
+		const float centerDist2 = LengthSquared(sphere.position - ray.origin);
+		if (centerDist2 <= radius2) return 0.0;
+
+		const float selectionPdf = luminance * 2.0 * TWO_PI * radius2 / lightPower;
+		return selectionPdf / (TWO_PI * (1.0 - sqrt(1.0 - radius2 / centerDist2)));
+	}
+	return 0.0;
+}
+
+// https://blog.demofox.org/2017/01/09/raytracing-reflection-refraction-fresnel-total-internal-reflection-and-beers-law/
+float FresnelReflectAmount(in float n1, in float n2, in vec3 normal, in vec3 incident, in float reflectivity)
+{
+	// Schlick aproximation
+	float r0 = (n1-n2) / (n1+n2);
+	r0 *= r0;
+	float cosX = -dot(normal, incident);
+	if (n1 > n2)
+	{
+	    float n = n1/n2;
+	    float sinT2 = n*n*(1.0-cosX*cosX);
+	    // Total internal reflection
+	    if (sinT2 > 1.0)
+	        return 1.0;
+	    cosX = sqrt(1.0-sinT2);
+	}
+	float x = 1.0-cosX;
+	float ret = r0+(1.0-r0)*x*x*x*x*x;
+	ret = (reflectivity + (1.0-reflectivity) * ret);
+	return ret;
+}
+
+// Power heuristic for two one-sample techniques, weight of the one with pdf a
+float PowerHeuristic(in float a, in float b) {
+	return a * a / (a * a + b * b);
+}
+
+// One bounce of a path at hitInfo: adds the emission that was hit and a light sample, then picks
+// the next direction. bsdfPdf is the solid angle pdf the current ray was sampled with, 0 for
+// camera rays and mirror-like lobes, whose emitter hits then aren't weighted against light sampling.
+// Returns false once the path has ended, the sample is incomingLight.
+bool ShadeBounce(in HitInfo hitInfo, inout Ray ray, inout vec3 rayColor, inout vec3 incomingLight, inout float bsdfPdf, inout int currBounces, inout uint state) {
+	if (hitInfo.hasHit && hitInfo.hitDist < INFINITY) {
+		if (debugNormal) {
+			incomingLight = hitInfo.hitNormal;
+			currBounces = 1;
+			return false;
+		}
+
+		// Decisions at base + 0..3, the light sample at base + 5..7 and the direction at base + 8..9
+		const int dimension = BounceDimension(currBounces);
+		currBounces++;
+
+		const Material material = hitInfo.hitMaterial;
+		if (material.emissionStrength > 0.0) {
+			const float misWeight = bsdfPdf > 0.0 ? PowerHeuristic(bsdfPdf, LightPdf(hitInfo, ray)) : 1.0;
+			incomingLight += rayColor * material.emissionColor.rgb * material.emissionStrength * misWeight;
+		}
+		
+		ray.origin = hitInfo.hitPoint;
+		
+		const float ior = hitInfo.frontFace ? (1.0 / material.ior) : material.ior;
+
+		// One lobe is picked and only that one is sampled: GGX transmission with the Fresnel
+		// probability, GGX specular with specularChance, otherwise the base lobe
+		SetSampleDimension(state, dimension);
+		const bool isRefracted = hasRefraction && material.refractionAmount > 0.0 &&
+			FresnelReflectAmount(ior, material.ior, hitInfo.hitNormal, ray.direction, 1.0 - material.refractionAmount) < RandomValue(state);
+		SetSampleDimension(state, dimension + 1);
+		const bool isSpecularBounce = hasSpecular && !isRefracted && material.specularChance > RandomValue(state);
+
+		// The base lobe is Lambertian, or GGX reflection tinted by baseColor with probability smoothness
+		SetSampleDimension(state, dimension + 2);
+		const bool isDiffuse = !isRefracted && !isSpecularBounce && material.smoothness <= RandomValue(state);
+
+		vec3 tangent, bitangent;
+		OrthonormalBasis(hitInfo.hitNormal, tangent, bitangent);
+
+		if (isDiffuse) {
+			// Next-event estimation, one shadow ray toward a light picked by power
+			vec3 lightDirection, lightRadiance;
+			float lightDist, lightPdf;
+			SetSampleDimension(state, dimension + 5);
+			if (hasLights && SampleLight(ray.origin, lightDirection, lightDist, lightRadiance, lightPdf, state)) {
+				const float cosSurface = dot(hitInfo.hitNormal, lightDirection);
+				if (cosSurface > 0.0 && !Occluded(Ray(ray.origin, lightDirection), 0.0002, lightDist * 0.999)) {
+					const float misWeight = PowerHeuristic(lightPdf, cosSurface / PI);
+					incomingLight += rayColor * material.baseColor.rgb / PI * cosSurface * lightRadiance / lightPdf * misWeight;
+				}
+			}
+
+			SetSampleDimension(state, dimension + 8);
+			const vec3 local = CosineDirectionLocal(state);
+			ray.direction = tangent * local.x + bitangent * local.y + hitInfo.hitNormal * local.z;
+			bsdfPdf = local.z / PI;
+			rayColor *= material.baseColor.rgb;
+		} else {
+			// Microfacet lobes aren't weighted against light sampling
+			bsdfPdf = 0.0;
+
+			const float smoothness = isRefracted || !isSpecularBounce ? material.smoothness : material.specularSmoothness;
+			const float alpha = max((1.0 - smoothness) * (1.0 - smoothness), 1e-3);
+
+			const vec3 view = vec3(-dot(ray.direction, tangent), -dot(ray.direction, bitangent), -dot(ray.direction, hitInfo.hitNormal));
+			SetSampleDimension(state, dimension + 8);
+			const vec3 halfVector = SampleGGXVNDF(view, alpha, state);
+
+			vec3 local = isRefracted ? refract(-view, halfVector, ior) : reflect(-view, halfVector);
+			if (isRefracted && local == vec3(0)) local = reflect(-view, halfVector); // Total internal reflection
+			const bool transmitted = dot(local, halfVector) < 0.0;
+			if (transmitted ? local.z >= 0.0 : local.z <= 0.0) return false; // Ended up on the wrong side of the surface
+
+			// Sampling visible normals leaves only the masking of the outgoing direction in the weight
+			const float lambdaView = SmithLambda(alpha, view.z);
+			const float lambdaLight = SmithLambda(alpha, abs(local.z));
+			const float shadowing = transmitted ? 1.0 / (1.0 + lambdaLight) : (1.0 + lambdaView) / (1.0 + lambdaView + lambdaLight);
+
+			ray.direction = normalize(tangent * local.x + bitangent * local.y + hitInfo.hitNormal * local.z);
+			rayColor *= (isSpecularBounce ? material.specularColor.rgb : material.baseColor.rgb) * shadowing;
+			//vec3 absorb = exp(-material.baseColor.rgb * hitInfo.travelDist); // Beer's law
+			//rayColor *= mix(vec3(1), absorb, isRefracted);
+		}
+
+		ray.origin += ray.direction * 0.0002; // Make sure ray doesn't collide again on the same point
+
+		if (material.maxDepth > 0 && currBounces >= material.maxDepth) return false;
+
+		// Russian roulette, paths that carry little are ended and the survivors weighted up to compensate
+		if (currBounces >= rouletteDepth) {
+			const float survival = clamp(max(rayColor.r, max(rayColor.g, rayColor.b)), 0.05, 1.0);
+			SetSampleDimension(state, dimension + 3);
+			if (RandomValue(state) > survival) return false;
+			rayColor /= survival;
+		}
+		return true;
+	} else {
+		currBounces++;
+		
+		incomingLight += rayColor * skyColor * skyIntensity;
+		return false;
+	}
+}
+
+// Adds a finished path to the path length stats, one atomic per subgroup where supported
+void RecordPathLength(in int bounces) {
+#ifdef GL_KHR_shader_subgroup_arithmetic
+	const uint subgroupBounces = subgroupAdd(uint(bounces));
+	const uint subgroupPaths = subgroupAdd(1u);
+	if (subgroupElect()) {
+		atomicAdd(finishedPaths, subgroupPaths);
+		atomicAdd(totalBounces, subgroupBounces);
+	}
+#else
+	atomicAdd(finishedPaths, 1u);
+	atomicAdd(totalBounces, uint(bounces));
+#endif
+}
+
+// Full path of one sample, black if the sample was deferred
+vec3 RayTrace(in Ray ray, inout uint state) {
+	vec3 rayColor = vec3(1);
+	vec3 incomingLight = vec3(0);
+	float bsdfPdf = 0.0;
+
+	// BVH visualisation
+//	for (int i = 0; i < nodes.length(); ++i) {
+//		float color = 0.01;
+//		if (HitAABB(nodes[i].boundsMin.xyz, nodes[i].boundsMax.xyz, ray)) incomingLight.xyz += color;
+//	}
+
+	// Raytracing, maxBounces is a compile-time constant so the compiler can unroll this
+	int currBounces = 0;
+	for (int i = 0; i < maxBounces; ++i) {
+
+		HitInfo hitInfo = CalculateRay(ray);
+		if (sampleDeferred) return vec3(0);
+
+		if (!ShadeBounce(hitInfo, ray, rayColor, incomingLight, bsdfPdf, currBounces, state)) break;
+	}
+
+	RecordPathLength(currBounces);
+	return incomingLight;
+}
+
+// Ray through a point of the image given in pixels
+Ray CameraRayThrough(in vec2 imagePoint) {
+	const vec2 viewportCenter = imagePoint / accumTexSize - 0.5;
+	const vec2 pixelPos = vec2(viewportCenter.x * accumTexSize.x / accumTexSize.y, viewportCenter.y); // In units of the image height
+
+	Ray ray;
+	ray.origin = cam.position;
+	ray.direction = normalize(vec3(cam.inverseView * vec4(-pixelPos.x, pixelPos.y, 1.0, 0.0)));
+	return ray;
+}
+
+// Primary ray through a pixel, also seeds the pixel's random state for the pass
+Ray CameraRay(in ivec2 pixel, out uint rngState) {
+	rngState = BeginSample(pixel);
+
+	// Anywhere in the pixel for anti-aliasing
+	const vec2 jitter = vec2(RandomValue(rngState), RandomValue(rngState));
+	return CameraRayThrough(vec2(pixel) + jitter);
+}
+
+// Alpha counts the samples of each pixel, deferred samples aren't in colorSum or count. The sum
+// of squared sample luminances goes into the running second moment.
+void AccumulateSamples(in ivec2 pixel, in vec3 colorSum, in float luminanceSquaredSum, in int count) {
+	vec4 accumulated = imageLoad(accumImage, pixel);
+	float sampleCount = currAccumPass == 1 ? 0.0 : accumulated.a;
+
+	if (count == 0) {
+		imageStore(accumImage, pixel, vec4(accumulated.rgb, sampleCount));
+		return;
+	}
+
+	const float weight = float(count) / (sampleCount + float(count));
+	vec3 finalColor = mix(accumulated.rgb, colorSum / float(count), weight);
+	float finalMoment = mix(imageLoad(momentsImage, pixel).r, luminanceSquaredSum / float(count), weight);
+
+	imageStore(accumImage, pixel, vec4(finalColor, sampleCount + float(count)));
+	imageStore(momentsImage, pixel, vec4(finalMoment));
+}
+
+// samplesPerPass samples of a pixel for the megakernels, with one accumulation image update
+void RenderPixel(in ivec2 pixel) {
+	vec3 colorSum = vec3(0);
+	float luminanceSquaredSum = 0.0;
+	int count = 0;
+
+	for (subSample = 0; subSample < samplesPerPass; ++subSample) {
+		sampleDeferred = false;
+
+		uint rngState;
+		Ray ray = CameraRay(pixel, rngState);
+
+		vec3 color = RayTrace(ray, rngState);
+		if (!sampleDeferred) {
+			colorSum += color;
+			luminanceSquaredSum += Luminance(color) * Luminance(color);
+			count++;
+		}
+	}
+
+	AccumulateSamples(pixel, colorSum, luminanceSquaredSum, count);
+}
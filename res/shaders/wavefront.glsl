@@ -0,0 +1,61 @@
+// Path state and queues shared by the wavefront passes (wf_*.comp), keep in sync with Wavefront.h
+
+#define WAVEFRONT_GROUP_SIZE 64
+
+struct PathState {
+	vec3 origin; uint rngState;
+	vec3 direction; int bounces;
+	vec3 rayColor; uint deferred;
+	vec3 pad0; float bsdfPdf;
+	vec3 incomingLight; float pad1;
+};
+
+layout (std430, binding = 14) buffer pathSSBO {
+	PathState paths[]; // One per pixel
+};
+layout (std430, binding = 15) buffer hitSSBO {
+	HitRecord hits[]; // Written by extension, read by shading
+};
+layout (std430, binding = 16) buffer queueSSBO {
+	uint queues[]; // Two ray queues of pathCount path indices, extension reads one while shading fills the other
+};
+layout (std430, binding = 17) buffer counterSSBO {
+	uint queueCount[2];
+	uint secondaryRays; // Paths extended after the first bounce this frame, for the timing stats
+	uvec3 dispatchSize; // glDispatchComputeIndirect arguments for the current queue, at byte offset 16
+};
+
+// Ray binning (wf_sort_*.comp): paths of the current queue are grouped by direction octant,
+// then by the Morton code of their origin, so an extension group traces similar rays
+#define SORT_ORIGIN_BITS 3 // Per axis
+#define SORT_BINS (8 << (3 * SORT_ORIGIN_BITS))
+
+layout (std430, binding = 20) buffer sortBinSSBO {
+	uint binCount[SORT_BINS];
+	uint binOffset[SORT_BINS]; // Exclusive prefix sum of binCount, bumped by the scatter
+};
+
+uniform int pathCount;
+uniform int currentQueue;
+uniform int currentBounce;
+
+uniform vec3 sortBoundsMin;
+uniform vec3 sortBoundsMax;
+
+void PushPath(in int queue, in uint path) {
+	queues[queue * pathCount + atomicAdd(queueCount[queue], 1u)] = path;
+}
+
+uint SortKey(in uint path) {
+	const vec3 direction = paths[path].direction;
+	const uint octant = (direction.x < 0.0 ? 1u : 0u) | (direction.y < 0.0 ? 2u : 0u) | (direction.z < 0.0 ? 4u : 0u);
+
+	const vec3 relative = clamp((paths[path].origin - sortBoundsMin) / max(sortBoundsMax - sortBoundsMin, vec3(1e-6)), 0.0, 0.9999);
+	const uvec3 cell = uvec3(relative * float(1 << SORT_ORIGIN_BITS));
+
+	uint morton = 0u;
+	for (int i = 0; i < SORT_ORIGIN_BITS; ++i) {
+		morton |= (((cell.x >> i) & 1u) << (3 * i)) | (((cell.y >> i) & 1u) << (3 * i + 1)) | (((cell.z >> i) & 1u) << (3 * i + 2));
+	}
+	return (octant << (3 * SORT_ORIGIN_BITS)) | morton;
+}
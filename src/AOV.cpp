@@ -0,0 +1,54 @@
+#include "AOV.h"
+#include "Renderer.h"
+
+FirstHitAOVs::FirstHitAOVs(int width, int height, ComputeVariantCache& cache, const ShaderDefines& defines) : width(width), height(height)
+{
+	SetVariant(cache, defines);
+
+	albedoTexID = Renderer::CreateTexture(width, height, GL_RGBA16F);
+	normalDepthTexID = Renderer::CreateTexture(width, height, GL_RGBA32F);
+	prevNormalDepthTexID = Renderer::CreateTexture(width, height, GL_RGBA32F);
+}
+
+FirstHitAOVs::~FirstHitAOVs()
+{
+	glDeleteTextures(1, &albedoTexID);
+	glDeleteTextures(1, &normalDepthTexID);
+	glDeleteTextures(1, &prevNormalDepthTexID);
+}
+
+void FirstHitAOVs::SetVariant(ComputeVariantCache& cache, const ShaderDefines& defines)
+{
+	program = &cache.Get("res/shaders/aov.comp", defines);
+	traced = false;
+}
+
+void FirstHitAOVs::Bind()
+{
+	glBindImageTexture(2, albedoTexID, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
+	glBindImageTexture(3, normalDepthTexID, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+	glBindImageTexture(6, prevNormalDepthTexID, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+}
+
+void FirstHitAOVs::Trace(Camera& camera)
+{
+	Bind();
+	program->Use();
+	program->SetUniformCamera(camera);
+	glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	glUseProgram(0);
+	traced = true;
+}
+
+void FirstHitAOVs::Update(Camera& camera)
+{
+	if (!traced) Trace(camera);
+}
+
+void FirstHitAOVs::Advance(Camera& camera)
+{
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+	glCopyImageSubData(normalDepthTexID, GL_TEXTURE_2D, 0, 0, 0, 0, prevNormalDepthTexID, GL_TEXTURE_2D, 0, 0, 0, 0, width, height, 1);
+	Trace(camera);
+}
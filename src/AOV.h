@@ -0,0 +1,31 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include "Shader.h"
+
+// First-hit albedo, normal and depth through each pixel center, traced once per view. The denoiser
+// reads them as edge guides, the reprojection also reads the previous view's normal and depth.
+// Image units 2 (albedo), 3 (normal, depth) and 6 (previous normal, depth) while bound.
+struct FirstHitAOVs
+{
+    GLuint albedoTexID, normalDepthTexID, prevNormalDepthTexID;
+
+    FirstHitAOVs(int width, int height, ComputeVariantCache& cache, const ShaderDefines& defines);
+    ~FirstHitAOVs();
+
+    void Update(Camera& camera); // Traces for camera unless that was already done since the last Invalidate
+    void Advance(Camera& camera); // Keeps the current buffers as the previous view's, then traces for camera
+    void Invalidate() { traced = false; } // The view or scene changed without an Advance
+    void Bind();
+
+    void SetVariant(ComputeVariantCache& cache, const ShaderDefines& defines);
+
+private:
+    ComputeProgram* program = nullptr; // Owned by the variant cache
+
+    int width, height;
+    bool traced = false;
+
+    void Trace(Camera& camera);
+};
@@ -0,0 +1,84 @@
+#include "Adaptive.h"
+
+AdaptivePipeline::AdaptivePipeline(int width, int height, ComputeVariantCache& cache, const ShaderDefines& defines) : width(width), height(height)
+{
+	SetVariant(cache, defines);
+
+	// Count, padding, indirect dispatch arguments at byte offset 16, then one entry per pixel from byte 32
+	glGenBuffers(1, &activeSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, activeSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 8 * sizeof(uint32_t) + width * height * sizeof(uint32_t), NULL, GL_DYNAMIC_COPY);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, activeSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+AdaptivePipeline::~AdaptivePipeline()
+{
+	glDeleteBuffers(1, &activeSSBO);
+}
+
+void AdaptivePipeline::SetVariant(ComputeVariantCache& cache, const ShaderDefines& defines)
+{
+	compactProgram = &cache.Get("res/shaders/rt_adaptive_compact.comp", defines);
+	dispatchProgram = &cache.Get("res/shaders/rt_adaptive_dispatch.comp", defines);
+	traceProgram = &cache.Get("res/shaders/rt_adaptive.comp", defines);
+}
+
+void AdaptivePipeline::SetRenderSize(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+}
+
+bool AdaptivePipeline::Render(int currAccumPass, int firstSample, int samplesPerPass, Camera& camera)
+{
+	if (currAccumPass == 1)
+	{
+		converged = false;
+		activeFraction = 1.0f;
+		passCount = 0;
+	}
+	if (converged) return false;
+
+	const GLintptr dispatchOffset = 4 * sizeof(uint32_t);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, activeSSBO);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(uint32_t), GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	compactProgram->Use();
+	compactProgram->SetUniform1i("currAccumPass", currAccumPass);
+	compactProgram->SetUniform1f("targetError", targetError);
+	compactProgram->SetUniform1i("minSamples", minSamples);
+	glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	dispatchProgram->Use();
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, activeSSBO);
+	traceProgram->Use();
+	traceProgram->SetUniform1i("currAccumPass", currAccumPass);
+	traceProgram->SetUniform1i("firstSample", firstSample);
+	traceProgram->SetUniform1i("samplesPerPass", samplesPerPass);
+	traceProgram->SetUniformCamera(camera);
+	glDispatchComputeIndirect(dispatchOffset);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT); // activeCount is read back and cleared after this
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+	glUseProgram(0);
+
+	// The count is of this pass's compaction, so an empty list means nothing was left to trace
+	if (++passCount % checkInterval == 0)
+	{
+		GLuint activeCount = 0;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, activeSSBO);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(activeCount), &activeCount);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		activeFraction = (float)activeCount / (width * height);
+		converged = activeCount == 0;
+	}
+	return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include "Shader.h"
+
+// Adaptive sampling: before each pass a compaction lists the pixels whose mean luminance still has
+// a relative standard error above targetError, and an indirect dispatch traces only those. Once the
+// list is empty the pipeline stops rendering until the accumulation is reset.
+struct AdaptivePipeline
+{
+    float targetError = 0.02f;
+    int minSamples = 16; // Every pixel gets at least this many before its variance is trusted
+    int checkInterval = 16; // Passes between reading the active count back, reading waits on the GPU
+
+    bool converged = false; // Every pixel is under targetError, set from the last read
+    float activeFraction = 1.0f; // Share of pixels traced by the last checked pass
+
+    AdaptivePipeline(int width, int height, ComputeVariantCache& cache, const ShaderDefines& defines);
+    ~AdaptivePipeline();
+
+    // False when nothing was traced because the image has converged
+    bool Render(int currAccumPass, int firstSample, int samplesPerPass, Camera& camera);
+    void SetVariant(ComputeVariantCache& cache, const ShaderDefines& defines);
+    void SetRenderSize(int width, int height); // Only this much of the image is compacted and counted from now on
+
+private:
+    ComputeProgram *compactProgram = nullptr, *dispatchProgram = nullptr, *traceProgram = nullptr; // Owned by the variant cache
+
+    GLuint activeSSBO;
+    int width, height;
+    int passCount = 0;
+};
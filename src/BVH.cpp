@@ -0,0 +1,385 @@
+#include "BVH.h"
+#include "Object.h"
+
+#include <queue>
+#include <algorithm>
+
+namespace
+{
+	// Clips the triangle against the box (Sutherland-Hodgman) and returns the bounds of what is left
+	bool ClipTriangleBounds(const Triangle& tri, glm::vec3 boxMin, glm::vec3 boxMax, PrimRef& ref)
+	{
+		// A triangle clipped by six planes has at most 9 vertices
+		glm::vec3 poly[9] = { glm::vec3(tri.p1), glm::vec3(tri.p2), glm::vec3(tri.p3) };
+		int count = 3;
+
+		for (int axis = 0; axis < 3 && count > 0; ++axis)
+		{
+			for (int side = 0; side < 2 && count > 0; ++side)
+			{
+				glm::vec3 clipped[9];
+				int clippedCount = 0;
+
+				for (int i = 0; i < count; ++i)
+				{
+					glm::vec3 a = poly[i];
+					glm::vec3 b = poly[(i + 1) % count];
+					float da = (side == 0) ? a[axis] - boxMin[axis] : boxMax[axis] - a[axis];
+					float db = (side == 0) ? b[axis] - boxMin[axis] : boxMax[axis] - b[axis];
+
+					if (da >= 0.0f) clipped[clippedCount++] = a;
+					if ((da >= 0.0f) != (db >= 0.0f)) clipped[clippedCount++] = glm::mix(a, b, da / (da - db));
+				}
+
+				for (int i = 0; i < clippedCount; ++i) poly[i] = clipped[i];
+				count = clippedCount;
+			}
+		}
+
+		if (count == 0) return false;
+
+		ref.boundsMin = glm::vec3(1e30f);
+		ref.boundsMax = glm::vec3(-1e30f);
+		for (int i = 0; i < count; ++i)
+		{
+			ref.boundsMin = glm::min(ref.boundsMin, poly[i]);
+			ref.boundsMax = glm::max(ref.boundsMax, poly[i]);
+		}
+		ref.boundsMin = glm::max(ref.boundsMin, boxMin);
+		ref.boundsMax = glm::min(ref.boundsMax, boxMax);
+		return true;
+	}
+}
+
+float PrimRef::SurfaceArea() const
+{
+	glm::vec3 size = boundsMax - boundsMin;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+void Node::GrowBounds(Triangle tri)
+{
+	boundsMin = glm::min(boundsMin, tri.p1);
+	boundsMax = glm::max(boundsMax, tri.p1);
+
+	boundsMin = glm::min(boundsMin, tri.p2);
+	boundsMax = glm::max(boundsMax, tri.p2);
+
+	boundsMin = glm::min(boundsMin, tri.p3);
+	boundsMax = glm::max(boundsMax, tri.p3);
+}
+
+void Node::GrowBounds(const PrimRef& ref)
+{
+	boundsMin = glm::min(boundsMin, glm::vec4(ref.boundsMin, 0.0f));
+	boundsMax = glm::max(boundsMax, glm::vec4(ref.boundsMax, 0.0f));
+}
+
+void BVH::Build(const std::vector<Triangle>& tris, const std::vector<Quad>& quads, const std::vector<Box>& boxes, const std::vector<Disc>& discs)
+{
+	double timeBeforeBuild = glfwGetTime();
+
+	nodes.clear();
+	primRefs.clear();
+
+	SplitLargeTriangles(tris);
+
+	for (int i = 0; i < boxes.size(); ++i)
+	{
+		PrimRef ref;
+		ref.primIndex = i;
+		ref.primType = PRIM_BOX;
+		ref.boundsMin = glm::vec3(boxes[i].boundsMin);
+		ref.boundsMax = glm::vec3(boxes[i].boundsMax);
+		refs.push_back(ref);
+	}
+
+	for (int i = 0; i < discs.size(); ++i)
+	{
+		// Extent of a disc along each axis is radius * sin(angle between the axis and the normal)
+		glm::vec3 normal = discs[i].normal;
+		glm::vec3 extent = discs[i].radius * glm::sqrt(glm::max(glm::vec3(1.0f) - normal * normal, glm::vec3(0.0f)));
+
+		PrimRef ref;
+		ref.primIndex = i;
+		ref.primType = PRIM_DISC;
+		ref.boundsMin = discs[i].position - extent;
+		ref.boundsMax = discs[i].position + extent;
+		refs.push_back(ref);
+	}
+
+	for (int i = 0; i < quads.size(); ++i)
+	{
+		const Quad& quad = quads[i];
+
+		PrimRef ref;
+		ref.primIndex = i;
+		ref.primType = PRIM_QUAD;
+		ref.boundsMin = glm::min(glm::min(glm::vec3(quad.p1), glm::vec3(quad.p2)), glm::min(glm::vec3(quad.p3), glm::vec3(quad.p4)));
+		ref.boundsMax = glm::max(glm::max(glm::vec3(quad.p1), glm::vec3(quad.p2)), glm::max(glm::vec3(quad.p3), glm::vec3(quad.p4)));
+		refs.push_back(ref);
+	}
+
+	if (refs.empty()) return;
+
+	Node root;
+	for (int i = 0; i < refs.size(); ++i)
+	{
+		root.GrowBounds(refs[i]);
+	}
+	root.numTris = refs.size();
+	nodes.push_back(root);
+
+	SplitNode(0, maxDepth);
+
+	leafBlocks.clear();
+	if (compressLeaves) CompressLeaves(tris);
+
+	for (int i = 0; i < refs.size(); ++i)
+	{
+		primRefs.push_back((refs[i].primType << PRIM_TYPE_SHIFT) | refs[i].primIndex);
+	}
+	refs.clear();
+
+	double timeAfterBuild = glfwGetTime();
+	if (!printStats) return;
+
+	std::cout << "\n\tBVH took " << timeAfterBuild - timeBeforeBuild << " seconds to build" << "\n";
+	std::cout << "\tBVH has " << nodes.size() << " nodes" << "\n";
+	std::cout << "\tBVH has " << leafBlocks.size() * sizeof(uint32_t) << " bytes of compressed leaves" << "\n";
+	std::cout << "\tBVH has " << primRefs.size() << " references to " << tris.size() << " triangles, "
+		<< quads.size() << " quads, " << boxes.size() << " boxes and " << discs.size() << " discs" << "\n\n";
+}
+
+// Early split clipping (Ernst & Greiner): references with oversized bounds are halved along
+// their longest axis, and the triangle is clipped to each half to get tight bounds. The largest
+// references are split first until they are small enough or the reference budget is used up.
+void BVH::SplitLargeTriangles(const std::vector<Triangle>& tris)
+{
+	refs.clear();
+
+	float totalArea = 0.0f;
+	for (int i = 0; i < tris.size(); ++i)
+	{
+		PrimRef ref;
+		ref.primIndex = i;
+		ref.boundsMin = glm::min(glm::min(glm::vec3(tris[i].p1), glm::vec3(tris[i].p2)), glm::vec3(tris[i].p3));
+		ref.boundsMax = glm::max(glm::max(glm::vec3(tris[i].p1), glm::vec3(tris[i].p2)), glm::vec3(tris[i].p3));
+		totalArea += ref.SurfaceArea();
+		refs.push_back(ref);
+	}
+
+	if (refs.empty()) return;
+
+	// Each triangle is compared with the average of the others, so in a small set a huge triangle
+	// doesn't raise its own bar. Pieces keep the threshold of their triangle.
+	std::vector<float> areaThresholds(tris.size(), 1e30f);
+	for (int i = 0; i < refs.size() && refs.size() > 1; ++i)
+	{
+		areaThresholds[i] = splitAreaFactor * (totalArea - refs[i].SurfaceArea()) / (refs.size() - 1);
+	}
+	auto tooLarge = [&](const PrimRef& ref) { return ref.SurfaceArea() > areaThresholds[ref.primIndex]; };
+
+	const size_t maxRefs = refs.size() + glm::max((size_t)(refs.size() * splitBudget), (size_t)minSplitRefs);
+
+	auto smallerArea = [this](int a, int b) { return refs[a].SurfaceArea() < refs[b].SurfaceArea(); };
+	std::priority_queue<int, std::vector<int>, decltype(smallerArea)> largest(smallerArea);
+
+	for (int i = 0; i < refs.size(); ++i)
+	{
+		if (tooLarge(refs[i])) largest.push(i);
+	}
+
+	while (!largest.empty() && refs.size() < maxRefs)
+	{
+		int index = largest.top();
+		largest.pop();
+
+		PrimRef ref = refs[index];
+		glm::vec3 size = ref.boundsMax - ref.boundsMin;
+		int splitAxis = (size.x > glm::max(size.y, size.z)) ? 0 : (size.y > size.z) ? 1 : 2;
+		float splitPos = (ref.boundsMin[splitAxis] + ref.boundsMax[splitAxis]) * 0.5f;
+
+		glm::vec3 leftMax = ref.boundsMax;
+		leftMax[splitAxis] = splitPos;
+		glm::vec3 rightMin = ref.boundsMin;
+		rightMin[splitAxis] = splitPos;
+
+		PrimRef left, right;
+		left.primIndex = ref.primIndex;
+		right.primIndex = ref.primIndex;
+		bool hasLeft = ClipTriangleBounds(tris[ref.primIndex], ref.boundsMin, leftMax, left);
+		bool hasRight = ClipTriangleBounds(tris[ref.primIndex], rightMin, ref.boundsMax, right);
+
+		if (!hasLeft && !hasRight) continue;
+
+		if (hasLeft && hasRight)
+		{
+			refs[index] = left;
+			refs.push_back(right);
+			if (tooLarge(right)) largest.push(refs.size() - 1);
+		}
+		else
+		{
+			// The triangle only touches one half, so this just tightens the bounds
+			refs[index] = hasLeft ? left : right;
+		}
+
+		if (tooLarge(refs[index])) largest.push(index);
+	}
+}
+
+bool BVH::SplitsLargeTriangles()
+{
+	std::vector<Triangle> tris(2);
+	tris[0].p1 = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	tris[0].p2 = glm::vec4(10000.0f, 0.0f, 0.0f, 0.0f);
+	tris[0].p3 = glm::vec4(0.0f, 0.0f, 10000.0f, 0.0f);
+	tris[1].p1 = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+	tris[1].p2 = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+	tris[1].p3 = glm::vec4(0.0f, 2.0f, 0.0f, 0.0f);
+
+	BVH bvh;
+	bvh.printStats = false;
+	bvh.Build(tris, {}, {}, {});
+	return bvh.primRefs.size() > tris.size();
+}
+
+void BVH::SplitNode(int nodeIndex, int depth)
+{
+	Node parent = nodes[nodeIndex];
+	if (depth <= 0 || parent.numTris <= maxLeafTris) return;
+
+	glm::vec3 centroidMin = glm::vec3(1e30f);
+	glm::vec3 centroidMax = glm::vec3(-1e30f);
+	for (int i = parent.triIndex; i < parent.triIndex + parent.numTris; ++i)
+	{
+		glm::vec3 centroid = (refs[i].boundsMin + refs[i].boundsMax) * 0.5f;
+		centroidMin = glm::min(centroidMin, centroid);
+		centroidMax = glm::max(centroidMax, centroid);
+	}
+
+	glm::vec3 size = centroidMax - centroidMin;
+	int splitAxis = (size.x > glm::max(size.y, size.z)) ? 0 : (size.y > size.z) ? 1 : 2;
+	float splitPos = (centroidMin[splitAxis] + centroidMax[splitAxis]) * 0.5f;
+
+	int splitIndex = parent.triIndex;
+	for (int i = parent.triIndex; i < parent.triIndex + parent.numTris; ++i)
+	{
+		float centroid = (refs[i].boundsMin[splitAxis] + refs[i].boundsMax[splitAxis]) * 0.5f;
+		if (centroid < splitPos) std::swap(refs[i], refs[splitIndex++]);
+	}
+
+	// Every centroid ended up on the same side, keep this node as a leaf
+	int numTrisA = splitIndex - parent.triIndex;
+	if (numTrisA == 0 || numTrisA == parent.numTris) return;
+
+	Node childA;
+	childA.triIndex = parent.triIndex;
+	childA.numTris = numTrisA;
+	Node childB;
+	childB.triIndex = splitIndex;
+	childB.numTris = parent.numTris - numTrisA;
+
+	for (int i = childA.triIndex; i < childA.triIndex + childA.numTris; ++i) childA.GrowBounds(refs[i]);
+	for (int i = childB.triIndex; i < childB.triIndex + childB.numTris; ++i) childB.GrowBounds(refs[i]);
+
+	int childrenIndex = nodes.size();
+	nodes[nodeIndex].childrenIndex = childrenIndex;
+	nodes[nodeIndex].numTris = 0;
+	nodes.push_back(childA);
+	nodes.push_back(childB);
+
+	SplitNode(childrenIndex, depth - 1);
+	SplitNode(childrenIndex + 1, depth - 1);
+}
+
+void BVH::CompressLeaves(const std::vector<Triangle>& tris)
+{
+	for (int n = 0; n < nodes.size(); ++n)
+	{
+		Node& node = nodes[n];
+		if (node.numTris == 0 || node.numTris > 255) continue;
+
+		// Split references don't cover their whole triangle, so the leaf bounds can't be used to quantize them
+		bool compressible = true;
+		for (int i = node.triIndex; i < node.triIndex + node.numTris && compressible; ++i)
+		{
+			if (refs[i].primType != PRIM_TRIANGLE) { compressible = false; break; }
+
+			const Triangle& tri = tris[refs[i].primIndex];
+			glm::vec3 triMin = glm::min(glm::min(glm::vec3(tri.p1), glm::vec3(tri.p2)), glm::vec3(tri.p3));
+			glm::vec3 triMax = glm::max(glm::max(glm::vec3(tri.p1), glm::vec3(tri.p2)), glm::vec3(tri.p3));
+			compressible = triMin == refs[i].boundsMin && triMax == refs[i].boundsMax;
+		}
+		if (!compressible) continue;
+
+		// Shared vertices, mesh triangles come from one vertex array so shared positions are bit-identical
+		std::vector<glm::vec3> vertices;
+		std::vector<uint32_t> vertexIndices;
+		for (int i = node.triIndex; i < node.triIndex + node.numTris; ++i)
+		{
+			const Triangle& tri = tris[refs[i].primIndex];
+			glm::vec3 corners[3] = { glm::vec3(tri.p1), glm::vec3(tri.p2), glm::vec3(tri.p3) };
+
+			for (int c = 0; c < 3; ++c)
+			{
+				int v = std::find(vertices.begin(), vertices.end(), corners[c]) - vertices.begin();
+				if (v == vertices.size()) vertices.push_back(corners[c]);
+				vertexIndices.push_back(v);
+			}
+		}
+		if (vertices.size() > 255) continue;
+
+		glm::vec3 boundsMin = glm::vec3(node.boundsMin);
+		glm::vec3 extent = glm::vec3(node.boundsMax) - boundsMin;
+
+		// A vertex moves at most half a step per axis, and the neighbouring triangle's vertex in another
+		// leaf as well, so a full step covers both. It is turned into barycentric units by dividing with
+		// the smallest altitude of each triangle.
+		float stepLength = glm::length(extent / 65535.0f);
+		float slack = 0.0f;
+		for (int i = node.triIndex; i < node.triIndex + node.numTris; ++i)
+		{
+			const Triangle& tri = tris[refs[i].primIndex];
+			glm::vec3 edge1 = glm::vec3(tri.p2 - tri.p1);
+			glm::vec3 edge2 = glm::vec3(tri.p3 - tri.p1);
+			glm::vec3 edge3 = glm::vec3(tri.p3 - tri.p2);
+			float maxEdge = glm::max(glm::length(edge1), glm::max(glm::length(edge2), glm::length(edge3)));
+			float minAltitude = glm::length(glm::cross(edge1, edge2)) / glm::max(maxEdge, 1e-30f);
+			slack = glm::max(slack, minAltitude > 0.0f ? stepLength / minAltitude : 1e30f); // No slack covers a degenerate triangle
+		}
+		// Clamping would leave cracks, a leaf that needs more slack keeps its full-precision triangles
+		if (slack > maxQuantSlack) continue;
+
+		node.leafBlock = leafBlocks.size();
+		leafBlocks.push_back(vertices.size() | (node.numTris << 8));
+		leafBlocks.push_back(glm::floatBitsToUint(slack));
+
+		for (int i = node.triIndex; i < node.triIndex + node.numTris; ++i)
+		{
+			leafBlocks.push_back(refs[i].primIndex);
+		}
+
+		std::vector<uint32_t> quantized;
+		for (int v = 0; v < vertices.size(); ++v)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				float t = extent[axis] > 0.0f ? (vertices[v][axis] - boundsMin[axis]) / extent[axis] : 0.0f;
+				quantized.push_back((uint32_t)glm::clamp(glm::round(t * 65535.0f), 0.0f, 65535.0f));
+			}
+		}
+		for (int i = 0; i < quantized.size(); i += 2)
+		{
+			leafBlocks.push_back(quantized[i] | ((i + 1 < quantized.size() ? quantized[i + 1] : 0) << 16));
+		}
+
+		for (int i = 0; i < vertexIndices.size(); i += 4)
+		{
+			uint32_t packed = 0;
+			for (int j = 0; j < 4 && i + j < vertexIndices.size(); ++j) packed |= vertexIndices[i + j] << (j * 8);
+			leafBlocks.push_back(packed);
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <glm.hpp>
+
+struct Triangle;
+struct Quad;
+struct Box;
+struct Disc;
+
+// Leaf entries pack the primitive type into the top bits of the index, keep in sync with trace.glsl
+enum PrimType
+{
+    PRIM_TRIANGLE = 0,
+    PRIM_BOX = 1,
+    PRIM_DISC = 2,
+    PRIM_QUAD = 3,
+};
+
+constexpr int PRIM_TYPE_SHIFT = 28;
+constexpr int PRIM_INDEX_MASK = (1 << PRIM_TYPE_SHIFT) - 1;
+
+// Build-time reference to a primitive, only the bounds can differ from the primitive's own
+// bounds when a triangle has been split by the pre-pass
+struct PrimRef
+{
+    glm::vec3 boundsMin = glm::vec3(1e30f);
+    glm::vec3 boundsMax = glm::vec3(-1e30f);
+    int primIndex = 0;
+    int primType = PRIM_TRIANGLE;
+
+    float SurfaceArea() const;
+};
+
+struct Node
+{
+    glm::vec4 boundsMin = glm::vec4(1e30f);
+    glm::vec4 boundsMax = glm::vec4(-1e30f);
+    int triIndex = 0; // Leaf: first entry in BVH::primRefs
+    int numTris = 0; // Leaf if > 0, counts primitives of any type
+    int childrenIndex = 0; // Internal: left child, right child is childrenIndex + 1
+    int leafBlock = -1; // Leaf: offset of the compressed block in BVH::leafBlocks, -1 if not compressed
+
+    void GrowBounds(Triangle tri);
+    void GrowBounds(const PrimRef& ref);
+};
+
+struct BVH
+{
+    std::vector<Node> nodes;
+    std::vector<int> primRefs; // Leaf ranges point here, each entry is (type << PRIM_TYPE_SHIFT) | index
+
+    // Compressed leaves, triangles as shared vertices quantized to 16 bits inside the leaf bounds.
+    // Block layout in uints, keep in sync with IntersectLeaf in trace.glsl:
+    //  [0] vertex count | triangle count << 8
+    //  [1] barycentric slack (float bits) that covers the quantization error of this leaf
+    //  [2...] triangle index per triangle
+    //  then 3 x 16 bit per vertex, then 3 x 8 bit vertex indices per triangle
+    std::vector<uint32_t> leafBlocks;
+
+    int maxDepth = 24; // Keep in sync with the traversal stack size in trace.glsl
+    int maxLeafTris = 4;
+
+    bool compressLeaves = true; // Only leaves of whole (not split) triangles are compressed
+    float maxQuantSlack = 0.01f; // Leaves that need more slack than this to stay watertight are left uncompressed
+
+    // Early split clipping, oversized triangles are split into several references before the build
+    float splitBudget = 0.3f; // Max extra references as a fraction of the triangle count
+    int minSplitRefs = 64; // Extra references allowed however few triangles there are
+    float splitAreaFactor = 2.0f; // Split references whose bounds area exceeds this times the average of the other triangles
+
+    bool printStats = true;
+
+    void Build(const std::vector<Triangle>& tris, const std::vector<Quad>& quads, const std::vector<Box>& boxes, const std::vector<Disc>& discs);
+
+    // Self-check of the split pre-pass: a 10,000-unit triangle next to a unit one has to be split
+    static bool SplitsLargeTriangles();
+
+private:
+    std::vector<PrimRef> refs;
+
+    void SplitLargeTriangles(const std::vector<Triangle>& tris);
+    void SplitNode(int nodeIndex, int depth);
+    void CompressLeaves(const std::vector<Triangle>& tris);
+};
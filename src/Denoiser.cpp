@@ -0,0 +1,61 @@
+#include "Denoiser.h"
+#include "Renderer.h"
+
+Denoiser::Denoiser(int width, int height, ComputeVariantCache& cache) : width(width), height(height)
+{
+	filterProgram = &cache.Get("res/shaders/denoise_atrous.comp", {});
+
+	filterTexIDs[0] = Renderer::CreateTexture(width, height, GL_RGBA32F);
+	filterTexIDs[1] = Renderer::CreateTexture(width, height, GL_RGBA32F);
+
+	glGenQueries(1, &timerQuery);
+}
+
+Denoiser::~Denoiser()
+{
+	glDeleteTextures(2, filterTexIDs);
+	glDeleteQueries(1, &timerQuery);
+}
+
+GLuint Denoiser::Denoise(FirstHitAOVs& aovs, Camera& camera)
+{
+	// Last frame's time, only once the GPU is done with it
+	if (queryPending)
+	{
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(timerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(timerQuery, GL_QUERY_RESULT, &elapsed);
+			lastTimeMs = elapsed / 1e6f;
+			queryPending = false;
+		}
+	}
+	if (!queryPending) glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+
+	aovs.Update(camera);
+	aovs.Bind();
+
+	filterProgram->Use();
+	for (int i = 0; i < iterations; ++i)
+	{
+		GLuint output = filterTexIDs[i % 2];
+		glBindImageTexture(4, filterTexIDs[(i + 1) % 2], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+		glBindImageTexture(5, output, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+
+		filterProgram->SetUniform1i("fromAccumulation", i == 0);
+		filterProgram->SetUniform1i("stepSize", 1 << i);
+		glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+	glUseProgram(0);
+
+	if (!queryPending)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		queryPending = true;
+	}
+
+	return filterTexIDs[(iterations - 1) % 2];
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include "Shader.h"
+#include "AOV.h"
+
+// Edge-avoiding a-trous wavelet filter over the accumulation before display. The first-hit albedo,
+// normal and depth guide it, and the per-pixel luminance variance from the moments image sets how
+// much it smooths.
+struct Denoiser
+{
+    bool enabled = true;
+    int iterations = 5; // Kernel footprint doubles each iteration, 5 covers about 125 pixels
+
+    float lastTimeMs = 0.0f; // GPU time of the AOV pass and filter, from an earlier frame's timer query
+
+    Denoiser(int width, int height, ComputeVariantCache& cache);
+    ~Denoiser();
+
+    // Filters the accumulation into the texture returned, sample it instead of the accumulation.
+    // Traces the AOVs first if they aren't up to date for camera.
+    GLuint Denoise(FirstHitAOVs& aovs, Camera& camera);
+
+private:
+    ComputeProgram* filterProgram = nullptr; // Owned by the variant cache
+
+    GLuint filterTexIDs[2]; // Ping-pong between iterations
+    int width, height;
+
+    GLuint timerQuery;
+    bool queryPending = false;
+};
@@ -0,0 +1,72 @@
+#include "DynamicResolution.h"
+#include "Renderer.h"
+
+#include <iostream>
+
+constexpr float DynamicResolution::scales[];
+
+DynamicResolution::DynamicResolution(int width, int height, GLuint nativeAccumTexID, GLuint nativeMomentsTexID, ComputeVariantCache& cache) : width(width), height(height)
+{
+	upscaleProgram = &cache.Get("res/shaders/upscale.comp", {});
+
+	accumTexIDs[0] = nativeAccumTexID;
+	momentsTexIDs[0] = nativeMomentsTexID;
+
+	for (int i = 1; i < levelCount; ++i)
+	{
+		glm::ivec2 size = glm::max(glm::ivec2(glm::vec2(width, height) * scales[i]), glm::ivec2(1));
+		accumTexIDs[i] = Renderer::CreateTexture(size.x, size.y, GL_RGBA32F);
+		momentsTexIDs[i] = Renderer::CreateTexture(size.x, size.y, GL_R32F);
+	}
+
+	upscaledTexID = Renderer::CreateTexture(width, height, GL_RGBA16F);
+}
+
+DynamicResolution::~DynamicResolution()
+{
+	glDeleteTextures(levelCount - 1, accumTexIDs + 1);
+	glDeleteTextures(levelCount - 1, momentsTexIDs + 1);
+	glDeleteTextures(1, &upscaledTexID);
+}
+
+bool DynamicResolution::Update(bool moving, double passTime, double targetTime, int samplesPerPass)
+{
+	int newLevel = level;
+
+	if (!enabled || !moving) newLevel = 0;
+	else if (passTime > targetTime * 1.1 && samplesPerPass == 1) newLevel = glm::min(level + 1, levelCount - 1);
+	else if (level > 0)
+	{
+		// Cost goes with the pixel count, step up only when the larger level is expected to fit
+		float ratio = scales[level - 1] / scales[level];
+		if (passTime * ratio * ratio < targetTime * 0.9) newLevel = level - 1;
+	}
+
+	if (newLevel == level) return false;
+	level = newLevel;
+	std::cout << "Render scale " << scales[level] << "\n";
+	return true;
+}
+
+glm::ivec2 DynamicResolution::RenderSize() const
+{
+	return glm::max(glm::ivec2(glm::vec2(width, height) * scales[level]), glm::ivec2(1));
+}
+
+void DynamicResolution::Bind()
+{
+	glBindImageTexture(0, accumTexIDs[level], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+	glBindImageTexture(1, momentsTexIDs[level], 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+}
+
+GLuint DynamicResolution::Upscale()
+{
+	glBindImageTexture(9, upscaledTexID, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+	upscaleProgram->Use();
+	glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	glUseProgram(0);
+
+	return upscaledTexID;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <glm.hpp>
+
+#include "Shader.h"
+
+// Reduced internal resolution while the camera moves. Each scale level has its own accumulation and
+// moments images, bound to image units 0 and 1 in place of the native ones, so every render mode
+// traces fewer pixels without knowing about it. An edge-aware upscale produces the display image,
+// and once the camera stops rendering returns to the native images.
+struct DynamicResolution
+{
+    bool enabled = true;
+    int level = 0; // Into scales, 0 is native
+
+    DynamicResolution(int width, int height, GLuint nativeAccumTexID, GLuint nativeMomentsTexID, ComputeVariantCache& cache);
+    ~DynamicResolution();
+
+    // Steps the level from the time a pass took against its target. Only goes below native while
+    // moving, and only once samplesPerPass is down to one. True when the level changed, the
+    // accumulation has to restart then.
+    bool Update(bool moving, double passTime, double targetTime, int samplesPerPass);
+
+    glm::ivec2 RenderSize() const;
+    float Scale() const { return scales[level]; }
+    void Bind(); // Accumulation and moments images of the current level
+
+    GLuint Upscale(); // Display-size texture from the current level's accumulation, not for level 0
+
+private:
+    static constexpr float scales[] = { 1.0f, 0.75f, 0.5f, 0.35f };
+    static constexpr int levelCount = sizeof(scales) / sizeof(scales[0]);
+
+    ComputeProgram* upscaleProgram = nullptr; // Owned by the variant cache
+
+    int width, height;
+    GLuint accumTexIDs[levelCount], momentsTexIDs[levelCount]; // Level 0 are the renderer's own
+    GLuint upscaledTexID;
+};
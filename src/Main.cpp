@@ -5,16 +5,29 @@
 #include <gtx/rotate_vector.hpp>
 
 #include "Renderer.h"
+#include "Persistent.h"
+#include "Adaptive.h"
+#include "Wavefront.h"
+#include "Workgroup.h"
+#include "TileScheduler.h"
+#include "Denoiser.h"
+#include "Reprojection.h"
+#include "DynamicResolution.h"
+#include "Occlusion.h"
 
 int main()
 {
     // Sets window size to monitor size if both are null
     Renderer::Init(NULL, NULL);
 
+#ifdef _DEBUG
+    if (!BVH::SplitsLargeTriangles()) std::cout << "BVH split pre-pass left an oversized triangle whole\n";
+#endif
+
     //ShaderProgram rtProgram("res/shaders/rt.vert", "res/shaders/rt.frag");
     //ShaderProgram accumProgram("res/shaders/accum.vert", "res/shaders/accum.frag");
     
-    ComputeProgram computeProgram("res/shaders/rt.comp");
+    ComputeVariantCache variantCache;
     ShaderProgram computeAccumProgram("res/shaders/compute_accum.vert", "res/shaders/compute_accum.frag");
 
     Material specular;
@@ -68,10 +81,13 @@ int main()
     sun.emissionStrength = 5.0f;
     Renderer::scene.materials.push_back(sun);
 
-    Mesh mesh("res/meshes/bunny1.obj", 3);
+    //Renderer::scene.residency.pageTris = 4096; // Stream meshes bigger than this in pages
+    //Renderer::scene.residency.pageFilePath = "res/meshes/pages.bin";
+
+    Mesh mesh(Renderer::scene, "res/meshes/bunny1.obj", 3);
 
     Triangle(Renderer::scene, glm::vec3(-1.0, 0.0, 3.0), glm::vec3(1.0, 0.0, 3.0), glm::vec3(0.0, 1.4, 3.0), 4);
-    Triangle(Renderer::scene, glm::vec3(5000.0, 0.0, 5000.0), glm::vec3(-5000.0, 0.0, 5000.0), glm::vec3(0.0, 0.0, -5000.0), 3);
+    Plane(Renderer::scene, glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, 1.0, 0.0), 3);
 
     //for (int i = -6; i < 6; i++)
     //{
@@ -93,41 +109,125 @@ int main()
 
     Renderer::scene.SetupSSBOs();
 
+    // Compiled for what the scene contains, the N key switches to the debug variant
+    ShaderDefines defines = Renderer::scene.FeatureDefines();
+    defines["MAX_BOUNCES"] = 8;
+    defines["DEBUG_NORMAL"] = 0;
+
+    Renderer::camera.UpdateView();
+    WorkgroupTuner tuner;
+    glm::ivec2 workgroupSize = tuner.Tune(variantCache, defines, Renderer::screenWidth, Renderer::screenHeight, Renderer::camera);
+
+    // Only the megakernel takes the tuned shape
+    auto megakernelVariant = [&]()
+    {
+        ShaderDefines megakernelDefines = defines;
+        megakernelDefines["LOCAL_SIZE_X"] = workgroupSize.x;
+        megakernelDefines["LOCAL_SIZE_Y"] = workgroupSize.y;
+        return &variantCache.Get("res/shaders/rt.comp", megakernelDefines);
+    };
+
+    ComputeProgram* computeProgram = megakernelVariant();
+    TileScheduler tiles(Renderer::screenWidth, Renderer::screenHeight, workgroupSize); // Megakernel passes, spread over frames when heavy
+    PersistentPipeline persistent(Renderer::screenWidth, Renderer::screenHeight, variantCache, defines);
+    WavefrontPipeline wavefront(Renderer::screenWidth, Renderer::screenHeight, variantCache, defines);
+    AdaptivePipeline adaptive(Renderer::screenWidth, Renderer::screenHeight, variantCache, defines);
+    FirstHitAOVs aovs(Renderer::screenWidth, Renderer::screenHeight, variantCache, defines);
+    Denoiser denoiser(Renderer::screenWidth, Renderer::screenHeight, variantCache);
+    Reprojector reprojector(Renderer::screenWidth, Renderer::screenHeight, variantCache, defines);
+    DynamicResolution resolution(Renderer::screenWidth, Renderer::screenHeight, Renderer::accumTexID, Renderer::momentsTexID, variantCache);
+
+    glm::vec3 sceneMin, sceneMax;
+    Renderer::scene.Bounds(sceneMin, sceneMax);
+    wavefront.SetSortBounds(sceneMin, sceneMax);
+
     double prevFrameTime = 0.0;
     double currFrameTime = 0.0;
     double deltaTime = 0.0;
     
     int currAccumPass = 0;
+    int accumSamples = 0; // Samples per pixel since the accumulation was reset
+
+    int samplesPerPass = 1; // Megakernel modes only, wavefront always takes one
+    bool autoSamples = true; // Picks the largest samplesPerPass that stays within targetFrameTime, or the tile budget
+    const int maxSamplesPerPass = 64;
+    const double targetFrameTime = 1.0 / 60.0;
 
     bool keyPressed = false;
 
-    bool debugNormal = false;
+    bool modeKeyPressed = false;
+
+    enum RenderMode { MEGAKERNEL, PERSISTENT, WAVEFRONT, ADAPTIVE, RENDER_MODE_COUNT };
+    const char* renderModeNames[] = { "Megakernel", "Persistent", "Wavefront", "Adaptive" };
+    int renderMode = MEGAKERNEL;
+
+    bool sortKeyPressed = false;
+    bool timingKeyPressed = false;
+    bool denoiseKeyPressed = false;
+    bool reprojectKeyPressed = false;
+
+    Camera prevCamera = Renderer::camera; // View the accumulation was last rendered from
+    double lastMoveTime = -1.0; // Mouse input doesn't arrive every frame, moving counts for a moment after the last change
+    const float cameraRadius = 0.05f; // How close the camera gets to geometry
+
+    float averagePathLength = 0.0f;
+    int frameCount = 0;
 
     glBindVertexArray(Renderer::vao);
 
     while (!glfwWindowShouldClose(Renderer::window))
     {
+        glm::vec3 prevPosition = Renderer::camera.position;
+        Renderer::camera.ProcessInput(Renderer::window, deltaTime);
+
+        // The camera stops at geometry instead of flying through it, checked on the CPU against what the GPU traces
+        glm::vec3 step = Renderer::camera.position - prevPosition;
+        float stepLength = glm::length(step);
+        if (stepLength > 0.0f && Occluded(Renderer::scene, prevPosition, step / stepLength, 0.0f, stepLength + cameraRadius))
+        {
+            Renderer::camera.position = prevPosition;
+        }
+        Renderer::camera.UpdateView();
+
+        // The view changed since the last pass, the accumulation is carried over into the new view
+        // or started again
         if (Renderer::camera.moving)
         {
-            currAccumPass = 0;
+            lastMoveTime = glfwGetTime();
+
+            // Reprojection works on the native images, reduced-resolution frames just start over
+            if (reprojector.enabled && currAccumPass > 0 && resolution.level == 0)
+            {
+                reprojector.Reproject(Renderer::accumTexID, Renderer::momentsTexID, aovs, prevCamera, Renderer::camera);
+                tiles.Restart();
+                adaptive.converged = false;
+            }
+            else
+            {
+                currAccumPass = 0;
+            }
 
             glClear(GL_COLOR_BUFFER_BIT);
 
             Renderer::camera.moving = false;
         }
-
-        Renderer::camera.ProcessInput(Renderer::window, deltaTime);
-        Renderer::camera.UpdateView();
         
         // Normal debug view
         if (glfwGetKey(Renderer::window, GLFW_KEY_N))
         {
             if (!keyPressed)
             {
-                debugNormal = !debugNormal;
-                computeProgram.Use();
-                computeProgram.SetUniform1i("debugNormal", debugNormal);
-                computeProgram.Unuse();
+                // Normals only need the first hit
+                defines["DEBUG_NORMAL"] = !defines["DEBUG_NORMAL"];
+                defines["MAX_BOUNCES"] = defines["DEBUG_NORMAL"] ? 1 : 8;
+
+                computeProgram = megakernelVariant();
+                persistent.SetVariant(variantCache, defines);
+                wavefront.SetVariant(variantCache, defines);
+                adaptive.SetVariant(variantCache, defines);
+                aovs.SetVariant(variantCache, defines);
+                reprojector.SetVariant(variantCache, defines);
+                currAccumPass = 0;
             }
             keyPressed = true;
         }
@@ -135,21 +235,143 @@ int main()
         {
             keyPressed = false;
         }
+
+        // Cycles megakernel / persistent threads / wavefront / adaptive
+        if (glfwGetKey(Renderer::window, GLFW_KEY_M))
+        {
+            if (!modeKeyPressed)
+            {
+                renderMode = (renderMode + 1) % RENDER_MODE_COUNT;
+                currAccumPass = 0;
+            }
+            modeKeyPressed = true;
+        }
+        else
+        {
+            modeKeyPressed = false;
+        }
+        
+        // Wavefront ray binning
+        if (glfwGetKey(Renderer::window, GLFW_KEY_B))
+        {
+            if (!sortKeyPressed)
+            {
+                wavefront.sortRays = !wavefront.sortRays;
+            }
+            sortKeyPressed = true;
+        }
+        else
+        {
+            sortKeyPressed = false;
+        }
+        
+        // Wavefront timing, prints secondary ray traversal cost to compare B on and off
+        if (glfwGetKey(Renderer::window, GLFW_KEY_T))
+        {
+            if (!timingKeyPressed)
+            {
+                wavefront.timing = !wavefront.timing;
+            }
+            timingKeyPressed = true;
+        }
+        else
+        {
+            timingKeyPressed = false;
+        }
         
-        computeProgram.Use();
+        // Denoiser on / off
+        if (glfwGetKey(Renderer::window, GLFW_KEY_F))
+        {
+            if (!denoiseKeyPressed)
+            {
+                denoiser.enabled = !denoiser.enabled;
+            }
+            denoiseKeyPressed = true;
+        }
+        else
+        {
+            denoiseKeyPressed = false;
+        }
+
+        // Temporal reprojection on / off
+        if (glfwGetKey(Renderer::window, GLFW_KEY_R))
+        {
+            if (!reprojectKeyPressed)
+            {
+                reprojector.enabled = !reprojector.enabled;
+            }
+            reprojectKeyPressed = true;
+        }
+        else
+        {
+            reprojectKeyPressed = false;
+        }
+
         glBindFramebuffer(GL_FRAMEBUFFER, Renderer::rtFboID);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, Renderer::accumTexID);
 
-        currAccumPass++;
-        computeProgram.SetUniform1i("currAccumPass", currAccumPass);
-        computeProgram.SetUniformCamera(Renderer::camera);
-        
-        glDispatchCompute(Renderer::screenWidth / 8, Renderer::screenHeight / 8, 1);
+        // A reset drops the rest of a tiled pass, a new pass only starts once the last one is done
+        if (currAccumPass == 0) tiles.Restart();
+        if (!tiles.InPass())
+        {
+            currAccumPass++;
+            if (currAccumPass == 1)
+            {
+                accumSamples = 0;
+                aovs.Invalidate();
+            }
+        }
 
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        int passSamples = renderMode == WAVEFRONT ? 1 : samplesPerPass;
+        bool passDone = true;
+
+        if (renderMode == WAVEFRONT)
+        {
+            wavefront.Render(currAccumPass, accumSamples, Renderer::camera);
+        }
+        else if (renderMode == ADAPTIVE)
+        {
+            passDone = adaptive.Render(currAccumPass, accumSamples, samplesPerPass, Renderer::camera);
+        }
+        else if (renderMode == PERSISTENT)
+        {
+            persistent.Render(currAccumPass, accumSamples, samplesPerPass, Renderer::camera);
+        }
+        else
+        {
+            computeProgram->Use();
+            computeProgram->SetUniform1i("currAccumPass", currAccumPass);
+            computeProgram->SetUniform1i("firstSample", accumSamples);
+            computeProgram->SetUniform1i("samplesPerPass", samplesPerPass);
+            computeProgram->SetUniformCamera(Renderer::camera);
+
+            passDone = tiles.Dispatch(*computeProgram, samplesPerPass);
+
+            computeProgram->Unuse();
+        }
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        computeProgram.Unuse();
+
+        prevCamera = Renderer::camera;
+
+        if (passDone) accumSamples += passSamples;
+
+        // Stream in the pages deferred rays asked for
+        Renderer::scene.residency.Update(Renderer::scene.pool);
+
+        // The display samples texture unit 0, the upscaled or denoised image replaces the accumulation there
+        if (resolution.level > 0)
+        {
+            GLuint upscaledTexID = resolution.Upscale();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, upscaledTexID);
+        }
+        else if (denoiser.enabled)
+        {
+            GLuint denoisedTexID = denoiser.Denoise(aovs, Renderer::camera);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, denoisedTexID);
+        }
 
         computeAccumProgram.Use();
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, screenQuadIndices);
@@ -164,7 +386,38 @@ int main()
         currFrameTime = glfwGetTime();
         deltaTime = currFrameTime - prevFrameTime;
         std::string frameTime = std::to_string(deltaTime * 1000.0);
-        std::string title = "GLSL Raytracer | Frametime: " + frameTime + " ms" + " | Samples: " + std::to_string(currAccumPass);
+
+        // Frame time scales about linearly with the samples per pass, step down at once when over
+        // the target and grow by one while the estimate says another sample still fits. Tiled passes
+        // keep the frame time at the budget, there the whole pass's GPU time has to fit the budget,
+        // and the count only changes between passes.
+        double passTime = renderMode == MEGAKERNEL ? tiles.PassTimeMs(samplesPerPass) / 1000.0 : deltaTime;
+        double passTarget = renderMode == MEGAKERNEL ? tiles.budgetMs / 1000.0 : targetFrameTime;
+        if (autoSamples && renderMode != WAVEFRONT && passDone && passTime > 0.0)
+        {
+            double fitting = samplesPerPass * passTarget / passTime;
+            if (fitting < samplesPerPass) samplesPerPass = glm::max(1, (int)fitting);
+            else if (fitting >= samplesPerPass + 1) samplesPerPass = glm::min(maxSamplesPerPass, samplesPerPass + 1);
+        }
+
+        // Internal resolution drops while moving when one sample per pass still misses the target,
+        // and goes back to native once the camera has stopped
+        bool moving = currFrameTime - lastMoveTime < 0.25;
+        if (resolution.Update(moving, passTime, passTarget, passSamples))
+        {
+            glm::ivec2 renderSize = resolution.RenderSize();
+            resolution.Bind();
+            tiles.SetRenderSize(renderSize.x, renderSize.y);
+            adaptive.SetRenderSize(renderSize.x, renderSize.y);
+            currAccumPass = 0;
+        }
+
+        // Reading the stats waits on the GPU, so only every 30 frames
+        if (++frameCount % 30 == 0) averagePathLength = Renderer::ReadAveragePathLength();
+        std::string title = "GLSL Raytracer | Frametime: " + frameTime + " ms" + " | Samples: " + std::to_string(accumSamples) + " (" + std::to_string(passSamples) + " per pass)" + " | Avg path length: " + std::to_string(averagePathLength) + " | " + renderModeNames[renderMode] + (renderMode == WAVEFRONT && wavefront.sortRays ? " (sorted)" : "");
+        if (resolution.level > 0) title += " | Scale: " + std::to_string(resolution.Scale());
+        if (denoiser.enabled && resolution.level == 0) title += " | Denoise: " + std::to_string(denoiser.lastTimeMs) + " ms";
+        if (renderMode == ADAPTIVE) title += adaptive.converged ? " (converged)" : " (" + std::to_string((int)(adaptive.activeFraction * 100.0f)) + "% active)";
         glfwSetWindowTitle(Renderer::window, title.c_str());
         prevFrameTime = currFrameTime;
     }
@@ -1,29 +1,670 @@
 #include "Object.h"
 
-void Scene::SetupSSBOs()
+#include <sstream>
+#include <algorithm>
+
+namespace
 {
-	glGenBuffers(1, &materialSSBO);
-	glGenBuffers(1, &sphereSSBO);
+	float Luminance(glm::vec3 color)
+	{
+		return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+	}
+
+	template<typename T>
+	void WriteVector(std::ofstream& file, const std::vector<T>& data)
+	{
+		uint64_t count = data.size();
+		file.write((const char*)&count, sizeof(count));
+		file.write((const char*)data.data(), count * sizeof(T));
+	}
+
+	template<typename T>
+	void ReadVector(std::ifstream& file, std::vector<T>& data)
+	{
+		uint64_t count = 0;
+		file.read((char*)&count, sizeof(count));
+		data.resize(count);
+		file.read((char*)data.data(), count * sizeof(T));
+	}
+}
+
+int PoolAllocator::Alloc(int count)
+{
+	if (count == 0) return 0;
+
+	for (int i = 0; i < freeRanges.size(); ++i)
+	{
+		if (freeRanges[i].y < count) continue;
+
+		int offset = freeRanges[i].x;
+		freeRanges[i].x += count;
+		freeRanges[i].y -= count;
+		if (freeRanges[i].y == 0) freeRanges.erase(freeRanges.begin() + i);
+		return offset;
+	}
+
+	// Nothing fits, grow the pool and reuse a free range at the end if there is one
+	int offset = capacity;
+	if (!freeRanges.empty() && freeRanges.back().x + freeRanges.back().y == capacity)
+	{
+		offset = freeRanges.back().x;
+		freeRanges.pop_back();
+	}
+	capacity = offset + count;
+	return offset;
+}
+
+void PoolAllocator::Free(int offset, int count)
+{
+	if (count == 0) return;
+
+	int i = 0;
+	while (i < freeRanges.size() && freeRanges[i].x < offset) ++i;
+	freeRanges.insert(freeRanges.begin() + i, glm::ivec2(offset, count));
+
+	// Merge with the following and the preceding range
+	if (i + 1 < freeRanges.size() && freeRanges[i].x + freeRanges[i].y == freeRanges[i + 1].x)
+	{
+		freeRanges[i].y += freeRanges[i + 1].y;
+		freeRanges.erase(freeRanges.begin() + i + 1);
+	}
+	if (i > 0 && freeRanges[i - 1].x + freeRanges[i - 1].y == freeRanges[i].x)
+	{
+		freeRanges[i - 1].y += freeRanges[i].y;
+		freeRanges.erase(freeRanges.begin() + i);
+	}
+}
+
+int GeometryPool::Add(const std::vector<Triangle>& tris, const std::vector<Quad>& meshQuads, const BVH& bvh)
+{
+	MeshRecord record;
+	record.triOffset = triAllocator.Alloc(tris.size());
+	record.quadOffset = quadAllocator.Alloc(meshQuads.size());
+	record.primRefOffset = primRefAllocator.Alloc(bvh.primRefs.size());
+	record.leafBlockOffset = leafBlockAllocator.Alloc(bvh.leafBlocks.size());
+	int nodeOffset = nodeAllocator.Alloc(bvh.nodes.size());
+	record.rootIndex = bvh.nodes.empty() ? -1 : nodeOffset;
+
+	triangles.resize(triAllocator.capacity);
+	quads.resize(quadAllocator.capacity);
+	primRefs.resize(primRefAllocator.capacity);
+	nodes.resize(nodeAllocator.capacity);
+	leafBlocks.resize(leafBlockAllocator.capacity);
+
+	std::copy(tris.begin(), tris.end(), triangles.begin() + record.triOffset); // Converts to PrecomputedTriangle
+	std::copy(meshQuads.begin(), meshQuads.end(), quads.begin() + record.quadOffset);
+	std::copy(bvh.primRefs.begin(), bvh.primRefs.end(), primRefs.begin() + record.primRefOffset);
+	std::copy(bvh.nodes.begin(), bvh.nodes.end(), nodes.begin() + nodeOffset);
+	std::copy(bvh.leafBlocks.begin(), bvh.leafBlocks.end(), leafBlocks.begin() + record.leafBlockOffset);
+
+	MeshAllocation allocation = { (int)tris.size(), (int)meshQuads.size(), (int)bvh.nodes.size(), (int)bvh.primRefs.size(), (int)bvh.leafBlocks.size() };
+
+	if (!freeRecords.empty())
+	{
+		int meshIndex = freeRecords.back();
+		freeRecords.pop_back();
+		records[meshIndex] = record;
+		allocations[meshIndex] = allocation;
+		return meshIndex;
+	}
+
+	records.push_back(record);
+	allocations.push_back(allocation);
+	return records.size() - 1;
+}
+
+void GeometryPool::Remove(int meshIndex)
+{
+	if (meshIndex < 0 || meshIndex >= records.size()) return;
+
+	MeshRecord& record = records[meshIndex];
+	MeshAllocation& allocation = allocations[meshIndex];
+
+	triAllocator.Free(record.triOffset, allocation.numTris);
+	quadAllocator.Free(record.quadOffset, allocation.numQuads);
+	if (record.rootIndex >= 0) nodeAllocator.Free(record.rootIndex, allocation.numNodes);
+	primRefAllocator.Free(record.primRefOffset, allocation.numPrimRefs);
+	leafBlockAllocator.Free(record.leafBlockOffset, allocation.numLeafBlocks);
+
+	record = MeshRecord();
+	allocation = MeshAllocation();
+	freeRecords.push_back(meshIndex);
+}
+
+// Top-level tree over the root bounds of every traced mesh, stored in the node buffer with local child
+// indices like a mesh BVH. Each leaf holds one mesh record in triIndex.
+void GeometryPool::BuildTopLevel()
+{
+	if (topLevelRoot >= 0) nodeAllocator.Free(topLevelRoot, topLevelNodes);
+	topLevelRoot = -1;
+	topLevelNodes = 0;
+
+	topLevelRecords.clear();
+	for (int i = 0; i < records.size(); ++i)
+	{
+		if (records[i].rootIndex < 0 || (records[i].flags & MESH_PAGE)) continue;
+		const Node& root = nodes[records[i].rootIndex];
+		if (root.boundsMin.x > root.boundsMax.x) continue; // Empty mesh
+		topLevelRecords.push_back(i);
+	}
+	if (topLevelRecords.empty()) return;
+
+	std::vector<Node> topNodes(1);
+	SplitTopLevel(topNodes, 0, 0, topLevelRecords.size());
+
+	topLevelRoot = nodeAllocator.Alloc(topNodes.size());
+	topLevelNodes = topNodes.size();
+	nodes.resize(nodeAllocator.capacity);
+	std::copy(topNodes.begin(), topNodes.end(), nodes.begin() + topLevelRoot);
+}
+
+void GeometryPool::SplitTopLevel(std::vector<Node>& topNodes, int nodeIndex, int first, int count)
+{
+	Node node;
+	glm::vec3 centerMin = glm::vec3(1e30f), centerMax = glm::vec3(-1e30f);
+	for (int i = first; i < first + count; ++i)
+	{
+		const Node& root = nodes[records[topLevelRecords[i]].rootIndex];
+		node.boundsMin = glm::min(node.boundsMin, root.boundsMin);
+		node.boundsMax = glm::max(node.boundsMax, root.boundsMax);
+		centerMin = glm::min(centerMin, glm::vec3(root.boundsMin + root.boundsMax) * 0.5f);
+		centerMax = glm::max(centerMax, glm::vec3(root.boundsMin + root.boundsMax) * 0.5f);
+	}
+
+	if (count == 1)
+	{
+		node.triIndex = topLevelRecords[first];
+		node.numTris = 1;
+		topNodes[nodeIndex] = node;
+		return;
+	}
+
+	// Median split along the widest axis of the root centers, there are few meshes so the tree stays shallow
+	glm::vec3 extent = centerMax - centerMin;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	auto center = [&](int record) { const Node& root = nodes[records[record].rootIndex]; return root.boundsMin[axis] + root.boundsMax[axis]; };
+
+	int half = count / 2;
+	std::nth_element(topLevelRecords.begin() + first, topLevelRecords.begin() + first + half, topLevelRecords.begin() + first + count,
+		[&](int a, int b) { return center(a) < center(b); });
+
+	node.childrenIndex = topNodes.size();
+	topNodes[nodeIndex] = node;
+	topNodes.resize(topNodes.size() + 2);
+
+	SplitTopLevel(topNodes, node.childrenIndex, first, half);
+	SplitTopLevel(topNodes, node.childrenIndex + 1, first + half, count - half);
+}
+
+void GeometryPool::SetupSSBOs()
+{
+	glGenBuffers(1, &primRefSSBO);
+	glGenBuffers(1, &bvhSSBO);
 	glGenBuffers(1, &triangleSSBO);
+	glGenBuffers(1, &quadSSBO);
+	glGenBuffers(1, &leafBlockSSBO);
+	glGenBuffers(1, &meshRecordSSBO);
+}
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(Material), materials.data(), GL_DYNAMIC_DRAW);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, materialSSBO);
+void GeometryPool::UpdateSSBOs()
+{
+	BuildTopLevel();
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, primRefSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, primRefs.size() * sizeof(int), primRefs.data(), GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, primRefSSBO);
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, sphereSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, spheres.size() * sizeof(Sphere), spheres.data(), GL_DYNAMIC_DRAW);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, sphereSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, nodes.size() * sizeof(Node), nodes.data(), GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, bvhSSBO);
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, triangleSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, triangles.size() * sizeof(Triangle), triangles.data(), GL_DYNAMIC_DRAW);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, triangles.size() * sizeof(PrecomputedTriangle), triangles.data(), GL_DYNAMIC_DRAW);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, triangleSSBO);
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, quadSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, quads.size() * sizeof(Quad), quads.data(), GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, quadSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Top-level root, padding up to 16 bytes, then the records
+	const int recordHeader[4] = { topLevelRoot, 0, 0, 0 };
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshRecordSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(recordHeader) + records.size() * sizeof(MeshRecord), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(recordHeader), recordHeader);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(recordHeader), records.size() * sizeof(MeshRecord), records.data());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, meshRecordSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, leafBlockSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, leafBlocks.size() * sizeof(uint32_t), leafBlocks.data(), GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, leafBlockSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	uploadedTris = triangles.size();
+	uploadedQuads = quads.size();
+	uploadedNodes = nodes.size();
+	uploadedPrimRefs = primRefs.size();
+	uploadedLeafBlocks = leafBlocks.size();
+	uploadedRecords = records.size();
+
+	std::cout << "\n\tGeometry pool has " << records.size() << " meshes, " << triangles.size() << " triangles, "
+		<< quads.size() << " quads and " << nodes.size() << " nodes" << "\n\n";
+}
+
+int GeometryPool::TriangleCount(int meshIndex) const
+{
+	return allocations[meshIndex].numTris;
+}
+
+void GeometryPool::UpdateRecordSSBOs(int meshIndex)
+{
+	if (triangles.size() > uploadedTris || quads.size() > uploadedQuads || nodes.size() > uploadedNodes ||
+		primRefs.size() > uploadedPrimRefs || leafBlocks.size() > uploadedLeafBlocks || records.size() > uploadedRecords)
+	{
+		UpdateSSBOs();
+		return;
+	}
+
+	// Pages come and go without touching the top-level tree, any other mesh rebuilds it
+	bool traced = records[meshIndex].rootIndex >= 0 && !(records[meshIndex].flags & MESH_PAGE);
+	if (traced || std::find(topLevelRecords.begin(), topLevelRecords.end(), meshIndex) != topLevelRecords.end())
+	{
+		UpdateSSBOs();
+		return;
+	}
+
+	const MeshRecord& record = records[meshIndex];
+	const MeshAllocation& allocation = allocations[meshIndex];
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, primRefSSBO);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, record.primRefOffset * sizeof(int), allocation.numPrimRefs * sizeof(int), primRefs.data() + record.primRefOffset);
+
+	if (record.rootIndex >= 0)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhSSBO);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, record.rootIndex * sizeof(Node), allocation.numNodes * sizeof(Node), nodes.data() + record.rootIndex);
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, triangleSSBO);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, record.triOffset * sizeof(PrecomputedTriangle), allocation.numTris * sizeof(PrecomputedTriangle), triangles.data() + record.triOffset);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, quadSSBO);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, record.quadOffset * sizeof(Quad), allocation.numQuads * sizeof(Quad), quads.data() + record.quadOffset);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, leafBlockSSBO);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, record.leafBlockOffset * sizeof(uint32_t), allocation.numLeafBlocks * sizeof(uint32_t), leafBlocks.data() + record.leafBlockOffset);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshRecordSSBO);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(int) + meshIndex * sizeof(MeshRecord), sizeof(MeshRecord), &record);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+int ResidencyManager::AddPagedMesh(GeometryPool& pool, const std::vector<Triangle>& tris, const std::vector<Quad>& quads, const BVH& bvh)
+{
+	if (bvh.nodes.empty()) return pool.Add(tris, quads, bvh);
+
+	double timeBeforePaging = glfwGetTime();
+	int firstPage = pages.size();
+
+	// References under each node, children always come after their parent
+	std::vector<int> subtreeRefs(bvh.nodes.size());
+	for (int i = bvh.nodes.size() - 1; i >= 0; --i)
+	{
+		const Node& node = bvh.nodes[i];
+		subtreeRefs[i] = node.numTris > 0 ? node.numTris : subtreeRefs[node.childrenIndex] + subtreeRefs[node.childrenIndex + 1];
+	}
+
+	BVH top;
+	top.nodes.push_back(Node());
+	BuildTopLevel(bvh, tris, quads, subtreeRefs, 0, 0, top.nodes);
+
+	double timeAfterPaging = glfwGetTime();
+
+	std::cout << "\n\tPaging took " << timeAfterPaging - timeBeforePaging << " seconds" << "\n";
+	std::cout << "\tMesh has " << pages.size() - firstPage << " pages and " << top.nodes.size() << " resident top-level nodes" << "\n\n";
+
+	return pool.Add({}, {}, top);
+}
+
+void ResidencyManager::BuildTopLevel(const BVH& bvh, const std::vector<Triangle>& tris, const std::vector<Quad>& quads, const std::vector<int>& subtreeRefs, int src, int dst, std::vector<Node>& topNodes)
+{
+	const Node& node = bvh.nodes[src];
+
+	// Small enough subtrees become pages, the top-level node keeps their bounds and links to them
+	if (node.numTris > 0 || subtreeRefs[src] <= pageTris)
+	{
+		Node link;
+		link.boundsMin = node.boundsMin;
+		link.boundsMax = node.boundsMax;
+		link.childrenIndex = -(MakePage(bvh, tris, quads, src) + 1);
+		topNodes[dst] = link;
+		return;
+	}
+
+	int childrenIndex = topNodes.size();
+	topNodes.push_back(Node());
+	topNodes.push_back(Node());
+
+	Node inner = node;
+	inner.childrenIndex = childrenIndex;
+	topNodes[dst] = inner;
+
+	BuildTopLevel(bvh, tris, quads, subtreeRefs, node.childrenIndex, childrenIndex, topNodes);
+	BuildTopLevel(bvh, tris, quads, subtreeRefs, node.childrenIndex + 1, childrenIndex + 1, topNodes);
+}
+
+int ResidencyManager::MakePage(const BVH& bvh, const std::vector<Triangle>& tris, const std::vector<Quad>& quads, int root)
+{
+	std::vector<int> triIds, quadIds;
+	std::vector<int> stack = { root };
+
+	while (!stack.empty())
+	{
+		const Node& node = bvh.nodes[stack.back()];
+		stack.pop_back();
+
+		if (node.numTris == 0)
+		{
+			stack.push_back(node.childrenIndex);
+			stack.push_back(node.childrenIndex + 1);
+			continue;
+		}
+
+		for (int i = node.triIndex; i < node.triIndex + node.numTris; ++i)
+		{
+			int index = bvh.primRefs[i] & PRIM_INDEX_MASK;
+			if ((bvh.primRefs[i] >> PRIM_TYPE_SHIFT) == PRIM_QUAD) quadIds.push_back(index);
+			else triIds.push_back(index);
+		}
+	}
+
+	// A split triangle can be referenced more than once, it is stored in every page that uses it
+	std::sort(triIds.begin(), triIds.end());
+	triIds.erase(std::unique(triIds.begin(), triIds.end()), triIds.end());
+	std::sort(quadIds.begin(), quadIds.end());
+	quadIds.erase(std::unique(quadIds.begin(), quadIds.end()), quadIds.end());
+
+	GeometryPage page;
+	for (int id : triIds) page.tris.push_back(tris[id]);
+	for (int id : quadIds) page.quads.push_back(quads[id]);
+	hasQuads |= !page.quads.empty();
+
+	page.bvh.printStats = false;
+	page.bvh.Build(page.tris, page.quads, {}, {});
+	page.bytes = page.tris.size() * sizeof(PrecomputedTriangle) + page.quads.size() * sizeof(Quad) + page.bvh.nodes.size() * sizeof(Node)
+		+ page.bvh.primRefs.size() * sizeof(int) + page.bvh.leafBlocks.size() * sizeof(uint32_t);
+
+	if (!pageFilePath.empty())
+	{
+		std::ofstream file(pageFilePath, pages.empty() ? std::ios::binary | std::ios::trunc : std::ios::binary | std::ios::app);
+		file.seekp(0, std::ios::end);
+		page.fileOffset = file.tellp();
+
+		WriteVector(file, page.tris);
+		WriteVector(file, page.quads);
+		WriteVector(file, page.bvh.nodes);
+		WriteVector(file, page.bvh.primRefs);
+		WriteVector(file, page.bvh.leafBlocks);
+
+		std::vector<Triangle>().swap(page.tris);
+		std::vector<Quad>().swap(page.quads);
+		std::vector<Node>().swap(page.bvh.nodes);
+		std::vector<int>().swap(page.bvh.primRefs);
+		std::vector<uint32_t>().swap(page.bvh.leafBlocks);
+	}
+
+	pages.push_back(std::move(page));
+	pageTable.push_back(-1);
+	return pages.size() - 1;
+}
+
+const GeometryPage& ResidencyManager::ReadPage(int pageIndex, GeometryPage& scratch) const
+{
+	const GeometryPage& page = pages[pageIndex];
+	if (page.fileOffset < 0) return page;
+
+	std::ifstream file(pageFilePath, std::ios::binary);
+	file.seekg(page.fileOffset);
+
+	ReadVector(file, scratch.tris);
+	ReadVector(file, scratch.quads);
+	ReadVector(file, scratch.bvh.nodes);
+	ReadVector(file, scratch.bvh.primRefs);
+	ReadVector(file, scratch.bvh.leafBlocks);
+	return scratch;
+}
+
+const GeometryPage& ResidencyManager::HostPage(int pageIndex) const
+{
+	if (pages[pageIndex].fileOffset < 0) return pages[pageIndex];
+
+	auto cached = hostCache.find(pageIndex);
+	if (cached != hostCache.end()) return cached->second;
+
+	// The page read longest ago makes room
+	if (hostCache.size() >= hostCachePages && !hostCacheOrder.empty())
+	{
+		hostCache.erase(hostCacheOrder.front());
+		hostCacheOrder.erase(hostCacheOrder.begin());
+	}
+
+	GeometryPage& page = hostCache[pageIndex];
+	ReadPage(pageIndex, page);
+	hostCacheOrder.push_back(pageIndex);
+	return page;
+}
+
+void ResidencyManager::LoadPage(GeometryPool& pool, int pageIndex)
+{
+	GeometryPage scratch;
+	const GeometryPage& host = ReadPage(pageIndex, scratch);
+
+	GeometryPage& page = pages[pageIndex];
+	page.poolIndex = pool.Add(host.tris, host.quads, host.bvh);
+
+	pool.records[page.poolIndex].flags = MESH_PAGE;
+	pool.UpdateRecordSSBOs(page.poolIndex);
+
+	pageTable[pageIndex] = page.poolIndex;
+	residentBytes += page.bytes;
+}
+
+void ResidencyManager::EvictPage(GeometryPool& pool, int pageIndex)
+{
+	GeometryPage& page = pages[pageIndex];
+
+	pool.Remove(page.poolIndex);
+	pool.UpdateRecordSSBOs(page.poolIndex);
+
+	pageTable[pageIndex] = -1;
+	page.poolIndex = -1;
+	residentBytes -= page.bytes;
+}
+
+void ResidencyManager::SetupSSBOs()
+{
+	glGenBuffers(1, &pageTableSSBO);
+	glGenBuffers(1, &pageFeedbackSSBO);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, pageTableSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, pageTable.size() * sizeof(int), pageTable.data(), GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, pageTableSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	std::vector<uint32_t> feedback(pages.size(), 0);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, pageFeedbackSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, feedback.size() * sizeof(uint32_t), feedback.data(), GL_DYNAMIC_READ);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, pageFeedbackSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glGenBuffers(readbackCount, readbackBuffers);
+	for (int i = 0; i < readbackCount; ++i)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[i]);
+		glBufferData(GL_COPY_WRITE_BUFFER, feedback.size() * sizeof(uint32_t), NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void ResidencyManager::Update(GeometryPool& pool)
+{
+	if (pages.empty()) return;
+	++frame;
+
+	// The oldest copy in the ring is read once its fence has passed. If the GPU is that far behind,
+	// nothing is copied this frame and the feedback keeps collecting bits until a later one.
+	GLsizeiptr feedbackBytes = pages.size() * sizeof(uint32_t);
+	std::vector<uint32_t> feedback;
+
+	GLsync& fence = readbackFences[currentReadback];
+	if (fence)
+	{
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+
+		glDeleteSync(fence);
+		fence = 0;
+
+		feedback.resize(pages.size());
+		glBindBuffer(GL_COPY_READ_BUFFER, readbackBuffers[currentReadback]);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, feedbackBytes, feedback.data());
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+
+	// Copy what the last trace used or missed into the ring and clear it for the next one
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, pageFeedbackSSBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[currentReadback]);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, feedbackBytes);
+	glClearBufferData(GL_COPY_READ_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	currentReadback = (currentReadback + 1) % readbackCount;
+
+	if (feedback.empty()) return; // The ring is still filling up
+
+	std::vector<int> requested;
+	for (int i = 0; i < pages.size(); ++i)
+	{
+		if (feedback[i] & PAGE_USED) pages[i].lastUsedFrame = frame;
+		if ((feedback[i] & PAGE_REQUESTED) && pageTable[i] < 0) requested.push_back(i);
+	}
+
+	bool changed = false;
+	std::vector<int> loaded;
+	for (int i = 0; i < requested.size() && i < maxLoadsPerFrame; ++i)
+	{
+		GeometryPage& page = pages[requested[i]];
+
+		// Make room by evicting the least recently used pages. Pages no ray needed lately go first, but
+		// a working set bigger than the budget evicts pages that are still in use as well, otherwise
+		// the request would never be served. Only the pages loaded in this update are kept.
+		while (residentBytes > 0 && residentBytes + page.bytes > budgetBytes)
+		{
+			int victim = -1;
+			for (int j = 0; j < pages.size(); ++j)
+			{
+				if (pageTable[j] < 0 || std::find(loaded.begin(), loaded.end(), j) != loaded.end()) continue;
+				if (victim < 0 || pages[j].lastUsedFrame < pages[victim].lastUsedFrame) victim = j;
+			}
+			if (victim < 0) break;
+
+			EvictPage(pool, victim);
+			changed = true;
+		}
+
+		// Everything resident was loaded in this update, the rest of the requests wait for a later one
+		if (residentBytes > 0 && residentBytes + page.bytes > budgetBytes) break;
+
+		LoadPage(pool, requested[i]);
+		loaded.push_back(requested[i]);
+		page.lastUsedFrame = frame;
+		changed = true;
+	}
+
+	if (!changed) return;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, pageTableSSBO);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, pageTable.size() * sizeof(int), pageTable.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void Scene::SetupSSBOs()
+{
+	glGenBuffers(1, &materialSSBO);
+	glGenBuffers(1, &sphereSSBO);
+	glGenBuffers(1, &planeSSBO);
+	glGenBuffers(1, &boxSSBO);
+	glGenBuffers(1, &discSSBO);
+	glGenBuffers(1, &lightSSBO);
+	pool.SetupSSBOs();
+	residency.SetupSSBOs();
+
+	UpdateSSBOs();
+}
+
+void Scene::Bounds(glm::vec3& boundsMin, glm::vec3& boundsMax) const
+{
+	boundsMin = glm::vec3(1e30f);
+	boundsMax = glm::vec3(-1e30f);
+
+	// Root of every traced mesh, a paged mesh's resident top level covers all its pages
+	for (const MeshRecord& record : pool.records)
+	{
+		if (record.rootIndex < 0 || (record.flags & MESH_PAGE)) continue;
+		const Node& root = pool.nodes[record.rootIndex];
+		if (root.boundsMin.x > root.boundsMax.x) continue; // Empty mesh
+		boundsMin = glm::min(boundsMin, glm::vec3(root.boundsMin));
+		boundsMax = glm::max(boundsMax, glm::vec3(root.boundsMax));
+	}
+	for (const Sphere& sphere : spheres)
+	{
+		boundsMin = glm::min(boundsMin, sphere.position - sphere.radius);
+		boundsMax = glm::max(boundsMax, sphere.position + sphere.radius);
+	}
+
+	if (boundsMin.x > boundsMax.x) boundsMin = boundsMax = glm::vec3(0);
+}
+
+std::map<std::string, int> Scene::FeatureDefines() const
+{
+	bool hasSpecular = false, hasRefraction = false;
+	for (const Material& material : materials)
+	{
+		hasSpecular |= material.specularChance > 0.0f;
+		hasRefraction |= material.refractionAmount > 0.0f;
+	}
+
+	// Pool contents rather than the standalone vectors, meshes add triangles and quads too.
+	// Paged meshes count before any page is resident, so streaming one in needs no recompile
+	return {
+		{ "HAS_TRIANGLES", !pool.triangles.empty() || !residency.pages.empty() },
+		{ "HAS_QUADS", !pool.quads.empty() || residency.hasQuads },
+		{ "HAS_BOXES", !boxes.empty() },
+		{ "HAS_DISCS", !discs.empty() },
+		{ "HAS_SPHERES", !spheres.empty() },
+		{ "HAS_PLANES", !planes.empty() },
+		{ "HAS_SPECULAR", hasSpecular },
+		{ "HAS_REFRACTION", hasRefraction },
+		{ "HAS_LIGHTS", !lights.empty() },
+	};
 }
 
 void Scene::UpdateSSBOs()
 {
+	// Standalone geometry is rebuilt and takes the place of its previous pool record
+	pool.Remove(standaloneIndex);
+	bvh.Build(triangles, quads, boxes, discs);
+	standaloneIndex = pool.Add(triangles, quads, bvh);
+	pool.UpdateSSBOs();
+
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialSSBO);
 	glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(Material), materials.data(), GL_DYNAMIC_DRAW);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, materialSSBO);
@@ -34,12 +675,121 @@ void Scene::UpdateSSBOs()
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, sphereSSBO);
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, triangleSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, triangles.size() * sizeof(Triangle), triangles.data(), GL_DYNAMIC_DRAW);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, triangleSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, planeSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, planes.size() * sizeof(Plane), planes.data(), GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, planeSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, boxSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, boxes.size() * sizeof(Box), boxes.data(), GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, boxSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, discSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, discs.size() * sizeof(Disc), discs.data(), GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, discSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Total power, padding up to 16 bytes, then the lights
+	BuildLights();
+	const float lightHeader[4] = { lightPower, 0.0f, 0.0f, 0.0f };
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(lightHeader) + lights.size() * sizeof(Light), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(lightHeader), lightHeader);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(lightHeader), lights.size() * sizeof(Light), lights.data());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 23, lightSSBO);
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
+void Scene::BuildLights()
+{
+	lights.clear();
+
+	auto addTriangle = [&](const PrecomputedTriangle& tri)
+	{
+		const Material& material = materials[glm::floatBitsToUint(tri.vertex.w)];
+		if (material.emissionStrength <= 0.0f) return;
+
+		Light light;
+		light.type = LIGHT_TRIANGLE;
+		light.position = tri.vertex;
+		light.edge1 = tri.edge1;
+		light.edge2 = tri.edge2;
+		light.radiance = glm::vec3(material.emissionColor) * material.emissionStrength;
+		lights.push_back(light);
+	};
+
+	// Pool triangles of every mesh, pages are read from the residency manager as they may not be resident
+	for (int i = 0; i < pool.records.size(); ++i)
+	{
+		const MeshRecord& record = pool.records[i];
+		if (record.rootIndex < 0 || (record.flags & MESH_PAGE)) continue;
+		for (int j = 0; j < pool.TriangleCount(i); ++j) addTriangle(pool.triangles[record.triOffset + j]);
+	}
+	for (int i = 0; i < residency.pages.size(); ++i)
+	{
+		GeometryPage scratch;
+		for (const Triangle& tri : residency.ReadPage(i, scratch).tris) addTriangle(PrecomputedTriangle(tri));
+	}
+
+	for (const Sphere& sphere : spheres)
+	{
+		const Material& material = materials[sphere.materialIndex];
+		if (material.emissionStrength <= 0.0f) continue;
+
+		Light light;
+		light.type = LIGHT_SPHERE;
+		light.position = glm::vec4(sphere.position, sphere.radius);
+		light.radiance = glm::vec3(material.emissionColor) * material.emissionStrength;
+		lights.push_back(light);
+	}
+
+	// Power of each light, sampling proportional to it
+	std::vector<float> power(lights.size());
+	lightPower = 0.0f;
+	for (int i = 0; i < lights.size(); ++i)
+	{
+		const Light& light = lights[i];
+		float area = light.type == LIGHT_TRIANGLE ?
+			0.5f * glm::length(glm::cross(glm::vec3(light.edge1), glm::vec3(light.edge2))) :
+			4.0f * 3.14159265f * light.position.w * light.position.w;
+		power[i] = Luminance(light.radiance) * area;
+		lightPower += power[i];
+	}
+	if (lightPower <= 0.0f)
+	{
+		lights.clear();
+		lightPower = 0.0f;
+		return;
+	}
+
+	// Vose's alias method, every slot keeps its own light with aliasProbability and otherwise
+	// points to a light that had more than its share
+	std::vector<float> scaled(lights.size());
+	std::vector<int> small, large;
+	for (int i = 0; i < lights.size(); ++i)
+	{
+		lights[i].selectionPdf = power[i] / lightPower;
+		scaled[i] = lights[i].selectionPdf * lights.size();
+		(scaled[i] < 1.0f ? small : large).push_back(i);
+	}
+	while (!small.empty() && !large.empty())
+	{
+		int lesser = small.back(); small.pop_back();
+		int greater = large.back(); large.pop_back();
+
+		lights[lesser].aliasProbability = scaled[lesser];
+		lights[lesser].alias = greater;
+
+		scaled[greater] += scaled[lesser] - 1.0f;
+		(scaled[greater] < 1.0f ? small : large).push_back(greater);
+	}
+	for (int i : large) { lights[i].aliasProbability = 1.0f; lights[i].alias = i; }
+	for (int i : small) { lights[i].aliasProbability = 1.0f; lights[i].alias = i; } // Only left by rounding
+
+	std::cout << "Light list has " << lights.size() << " emitters\n";
+}
+
 Sphere::Sphere(struct Scene& scene, glm::vec3 pos, float rad, unsigned int materialIndex)
 {
     this->position = pos;
@@ -49,6 +799,34 @@ Sphere::Sphere(struct Scene& scene, glm::vec3 pos, float rad, unsigned int mater
 	scene.spheres.push_back(*this);
 }
 
+Plane::Plane(struct Scene& scene, glm::vec3 pos, glm::vec3 normal, unsigned int materialIndex)
+{
+	this->normal = glm::normalize(normal);
+	this->offset = glm::dot(this->normal, pos);
+	this->materialIndex = materialIndex;
+
+	scene.planes.push_back(*this);
+}
+
+Box::Box(struct Scene& scene, glm::vec3 boundsMin, glm::vec3 boundsMax, unsigned int materialIndex)
+{
+	this->boundsMin = glm::vec4(glm::min(boundsMin, boundsMax), 0.0f);
+	this->boundsMax = glm::vec4(glm::max(boundsMin, boundsMax), 0.0f);
+	this->materialIndex = materialIndex;
+
+	scene.boxes.push_back(*this);
+}
+
+Disc::Disc(struct Scene& scene, glm::vec3 pos, glm::vec3 normal, float rad, unsigned int materialIndex)
+{
+	this->position = pos;
+	this->normal = glm::normalize(normal);
+	this->radius = rad;
+	this->materialIndex = materialIndex;
+
+	scene.discs.push_back(*this);
+}
+
 Triangle::Triangle()
 {
 	p1.x = 0.0f; p1.y = 0.0f; p1.z = 0.0f; p1.w = 0.0f;
@@ -74,40 +852,45 @@ glm::vec3 Triangle::Center()
 	return glm::vec3(cX, cY, cZ);
 }
 
-void Node::GrowBounds(Triangle tri)
+PrecomputedTriangle::PrecomputedTriangle(const Triangle& tri)
 {
-	boundsMin = glm::min(boundsMin, tri.p1);
-	boundsMax = glm::max(boundsMax, tri.p1);
-
-	boundsMin = glm::min(boundsMin, tri.p2);
-	boundsMax = glm::max(boundsMax, tri.p2);
+	vertex = glm::vec4(glm::vec3(tri.p1), glm::uintBitsToFloat(tri.materialIndex));
+	edge1 = tri.p2 - tri.p1;
+	edge2 = tri.p3 - tri.p1;
+}
 
-	boundsMin = glm::min(boundsMin, tri.p3);
-	boundsMax = glm::max(boundsMax, tri.p3);
+Quad::Quad()
+{
+	p1 = glm::vec4(0.0f);
+	p2 = glm::vec4(0.0f);
+	p3 = glm::vec4(0.0f);
+	p4 = glm::vec4(0.0f);
 }
 
-Mesh::Mesh(const char* filePath, uint32_t materialIndex)
+Quad::Quad(struct Scene& scene, glm::vec3 _p1, glm::vec3 _p2, glm::vec3 _p3, glm::vec3 _p4, unsigned int materialIndex)
 {
+	p1 = glm::vec4(_p1, 0.0f);
+	p2 = glm::vec4(_p2, 0.0f);
+	p3 = glm::vec4(_p3, 0.0f);
+	p4 = glm::vec4(_p4, 0.0f);
 	this->materialIndex = materialIndex;
-	Load(filePath);
-	GenBoundingBox();
 
-	std::cout << "\n\nMesh BVH size: " << nodes.size() << "\n\n";
+	scene.quads.push_back(*this);
+}
 
-	GLuint meshSSBO, bvhSSBO;
+Mesh::Mesh(struct Scene& scene, const char* filePath, uint32_t materialIndex)
+{
+	this->materialIndex = materialIndex;
+	Load(filePath);
 
-	glGenBuffers(1, &meshSSBO);
-	glGenBuffers(1, &bvhSSBO);
+	bvh.Build(tris, quads, {}, {});
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, tris.size() * sizeof(Triangle), tris.data(), GL_DYNAMIC_DRAW);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, meshSSBO);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	if (scene.residency.pageTris > 0 && bvh.primRefs.size() > scene.residency.pageTris)
+		meshIndex = scene.residency.AddPagedMesh(scene.pool, tris, quads, bvh);
+	else
+		meshIndex = scene.pool.Add(tris, quads, bvh);
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, bvhSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, nodes.size() * sizeof(Node), nodes.data(), GL_DYNAMIC_DRAW);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, bvhSSBO);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	std::cout << "\n\nMesh BVH size: " << bvh.nodes.size() << "\n\n";
 }
 
 void Mesh::Load(const char* filePath)
@@ -133,15 +916,29 @@ void Mesh::Load(const char* filePath)
 		}
 		else if (line.substr(0, 2) == "f ") // indices
 		{
-			glm::ivec4 index;
-			sscanf_s(line.c_str(), "f %i %i %i", &index.x, &index.y, &index.z);
-			index.w = 0;
-
-			index.x -= 1;
-			index.y -= 1;
-			index.z -= 1;
-
-			indices.push_back(index);
+			// Faces can have any number of "v", "v/vt" or "v/vt/vn" entries, only the position index is used
+			std::istringstream faceStream(line.substr(2));
+			std::vector<int> face;
+			std::string entry;
+
+			while (faceStream >> entry)
+			{
+				int index = std::stoi(entry.substr(0, entry.find('/')));
+				face.push_back(index > 0 ? index - 1 : (int)vertices.size() + index); // Negative indices are relative
+			}
+
+			if (face.size() == 4)
+			{
+				quadIndices.push_back(glm::ivec4(face[0], face[1], face[2], face[3]));
+			}
+			else
+			{
+				// Anything other than a quad is triangulated as a fan
+				for (int i = 2; i < face.size(); ++i)
+				{
+					indices.push_back(glm::ivec4(face[0], face[i - 1], face[i], 0));
+				}
+			}
 		}
 	}
 
@@ -159,82 +956,20 @@ void Mesh::Load(const char* filePath)
 		tris.push_back(tempTri);
 	}
 
-	std::cout << "\n\n\n\t'" << filePath << "' took " << timeAfterLoad - timeBeforeLoad << " seconds to load" << "\n";
-	std::cout << "\t'" << filePath << "' has " << indices.size() << " triangles" << "\n";
-	std::cout << "\t'" << filePath << "' has " << vertices.size() << " vertices" << "\n\n\n\n\n";
-}
-
-void Mesh::GenBoundingBox()
-{
-	Node root;
-
-	for (int i = 0; i < tris.size(); ++i)
+	// Quads are kept as bilinear patches instead of two triangles
+	for (int i = 0; i < quadIndices.size(); ++i)
 	{
-		root.GrowBounds(tris[i]);
+		Quad tempQuad;
+		tempQuad.p1 = vertices[quadIndices[i].x];
+		tempQuad.p2 = vertices[quadIndices[i].y];
+		tempQuad.p3 = vertices[quadIndices[i].z];
+		tempQuad.p4 = vertices[quadIndices[i].w];
+		tempQuad.materialIndex = this->materialIndex;
+		quads.push_back(tempQuad);
 	}
-	root.numTris = tris.size();
-	root.childrenIndex = 1;
-	nodes.push_back(root);
 
-	std::cout << "\n\tBounds min: " << "x: " << root.boundsMin.x << ", y: " << root.boundsMin.y << ", z: " << root.boundsMin.z << "\n";
-	std::cout << "\tBounds max: " << "x: " << root.boundsMax.x << ", y: " << root.boundsMax.y << ", z: " << root.boundsMax.z << "\n\n\n\n\n";
+	std::cout << "\n\n\n\t'" << filePath << "' took " << timeAfterLoad - timeBeforeLoad << " seconds to load" << "\n";
+	std::cout << "\t'" << filePath << "' has " << indices.size() << " triangles" << "\n";
+	std::cout << "\t'" << filePath << "' has " << quadIndices.size() << " quads" << "\n";
+	std::cout << "\t'" << filePath << "' has " << vertices.size() << " vertices" << "\n\n\n\n\n";
 }
-
-void Mesh::SplitNode(Node parent, int depth)
-{
-	if (depth <= 0) return;
-	
-	parent.childrenIndex = nodes.size();
-
-	Node childA;
-	childA.triIndex = parent.triIndex;
-	Node childB;
-	childB.triIndex = parent.triIndex;
-
-	float sizeX = abs(parent.boundsMin.x) + abs(parent.boundsMax.x);
-	float sizeY = abs(parent.boundsMin.y) + abs(parent.boundsMax.y);
-	float sizeZ = abs(parent.boundsMin.z) + abs(parent.boundsMax.z);
-
-	std::cout << "\n\tMax X: " << sizeX << "\n";
-	std::cout << "\n\tMax Y: " << sizeY << "\n";
-	std::cout << "\n\tMax Z: " << sizeZ << "\n\n\n";
-
-	int splitAxis = (sizeX > glm::max(sizeY, sizeZ)) ? 0 : (sizeY > glm::max(sizeX, sizeZ)) ? 1 : 2;
-	//std::cout << "Split axis: " << ((splitAxis == 0) ? "X" : (splitAxis == 1) ? "Y" : (splitAxis == 2) ? "Z" : "This isn't supposed to happen") << std::endl;
-
-	for (int i = parent.triIndex; i < parent.triIndex + parent.numTris; i++)
-	{
-		bool inA = tris[i].Center()[splitAxis] < (parent.boundsMin[splitAxis] + parent.boundsMax[splitAxis]) / 2;
-		childA.GrowBounds(tris[i]);
-		childA.numTris++;
-
-		if (inA)
-		{
-			int swap = childA.triIndex + childA.numTris - 1;
-			std::swap(tris[i], tris[swap]);
-			childB.triIndex++;
-		}
-	}
-
-	nodes[parent.childrenIndex - 1].childrenIndex = parent.childrenIndex;
-	nodes.push_back(childA);
-	nodes.push_back(childB);
-
-	std::cout << "\n\tChildren start at index: " << nodes[parent.childrenIndex - 1].childrenIndex << "\n";
-
-	std::cout << "\n\tChild A bounds min: " << "x: " << childA.boundsMin.x << ", y: " << childA.boundsMin.y << ", z: " << childA.boundsMin.z << "\n";
-	std::cout << "\tChild A bounds max: " << "x: " << childA.boundsMax.x << ", y: " << childA.boundsMax.y << ", z: " << childA.boundsMax.z << "\n\n\n\n\n";
-
-	std::cout << "\n\tChild B bounds min: " << "x: " << childB.boundsMin.x << ", y: " << childB.boundsMin.y << ", z: " << childB.boundsMin.z << "\n";
-	std::cout << "\tChild B bounds max: " << "x: " << childB.boundsMax.x << ", y: " << childB.boundsMax.y << ", z: " << childB.boundsMax.z << "\n\n\n\n\n";
-
-	std::cout << "\n\tChild A tri start index: " << nodes[parent.childrenIndex].triIndex << "\n";
-	std::cout << "\n\tChild B tri start index: " << nodes[parent.childrenIndex + 1].triIndex << "\n";
-
-	std::cout << "\n\tParent tris: " << nodes[parent.childrenIndex - 1].numTris << "\n";
-	std::cout << "\n\tChild A tris: " << nodes[parent.childrenIndex].numTris << "\n";
-	std::cout << "\n\tChild B tris: " << nodes[parent.childrenIndex + 1].numTris << "\n\n\n\n\n";
-
-	if (nodes[parent.childrenIndex + 1].numTris > 1) SplitNode(nodes[parent.childrenIndex + 1], depth - 1);
-	if (nodes[parent.childrenIndex].numTris > 1) SplitNode(nodes[parent.childrenIndex], depth - 1);
-}
\ No newline at end of file
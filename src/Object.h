@@ -1,9 +1,12 @@
 #pragma once
 
 #include <vector>
+#include <map>
+#include <string>
 #include <glm.hpp>
 
 #include "Shader.h"
+#include "BVH.h"
 
 struct Material
 {
@@ -16,8 +19,9 @@ struct Material
     float ior = 1.5f;
     float refractionAmount = 0.0f;
     float specularChance = 0.0f;
+    int maxDepth = 0; // Paths end at this bounce count when they hit the material, 0 for no override
 private:
-    int pad[2];
+    int pad;
 };
 
 struct Sphere
@@ -32,6 +36,42 @@ private:
     int pad[3];
 };
 
+// Infinite plane, tested outside the BVH
+struct Plane
+{
+    glm::vec3 normal = glm::vec3(0, 1, 0);
+    float offset = 0.0f; // dot(normal, pointOnPlane)
+    unsigned int materialIndex = 0;
+
+    Plane(struct Scene& scene, glm::vec3 pos, glm::vec3 normal, unsigned int materialIndex);
+
+private:
+    int pad[3];
+};
+
+// Axis-aligned box
+struct Box
+{
+    glm::vec4 boundsMin = glm::vec4(0);
+    glm::vec4 boundsMax = glm::vec4(0);
+    unsigned int materialIndex = 0;
+
+    Box(struct Scene& scene, glm::vec3 boundsMin, glm::vec3 boundsMax, unsigned int materialIndex);
+
+private:
+    int pad[3];
+};
+
+struct Disc
+{
+    glm::vec3 position = glm::vec3(0);
+    float radius = 0.0f;
+    glm::vec3 normal = glm::vec3(0, 1, 0);
+    unsigned int materialIndex = 0;
+
+    Disc(struct Scene& scene, glm::vec3 pos, glm::vec3 normal, float rad, unsigned int materialIndex);
+};
+
 struct Triangle
 {
     glm::vec4 p1 = glm::vec4(0);
@@ -47,47 +87,241 @@ private:
     int pad[3];
 };
 
-struct Scene
+// Intersection-ready triangle as stored in the pool: one vertex and the two edges from it,
+// so the traversal doesn't rebuild edges per test. The material index is in the bits of vertex.w.
+struct PrecomputedTriangle
 {
-    std::vector<Material> materials;
-    std::vector<Sphere> spheres;
-    std::vector<Triangle> triangles;
+    glm::vec4 vertex = glm::vec4(0);
+    glm::vec4 edge1 = glm::vec4(0); // p2 - p1
+    glm::vec4 edge2 = glm::vec4(0); // p3 - p1
+
+    PrecomputedTriangle() = default;
+    PrecomputedTriangle(const Triangle& tri);
+};
+
+// Bilinear patch, corners in face winding order so p1-p2-p3-p4 go around the quad
+struct Quad
+{
+    glm::vec4 p1 = glm::vec4(0);
+    glm::vec4 p2 = glm::vec4(0);
+    glm::vec4 p3 = glm::vec4(0);
+    glm::vec4 p4 = glm::vec4(0);
+    unsigned int materialIndex = 0;
+
+    Quad();
+    Quad(struct Scene& scene, glm::vec3 _p1, glm::vec3 _p2, glm::vec3 _p3, glm::vec3 _p4, unsigned int materialIndex);
+
+private:
+    int pad[3];
+};
+
+// Emitter for next-event estimation, keep in sync with trace.glsl
+struct Light
+{
+    glm::vec4 position = glm::vec4(0); // Triangle: first vertex, sphere: center with the radius in w
+    glm::vec4 edge1 = glm::vec4(0); // Triangle only
+    glm::vec4 edge2 = glm::vec4(0);
+    glm::vec3 radiance = glm::vec3(0);
+    float aliasProbability = 1.0f; // Alias table: this light is kept with this probability, else alias is taken
+    int type = 0;
+    int alias = 0;
+    float selectionPdf = 0.0f; // Share of the total power
+private:
+    float pad;
+};
+
+enum LightType
+{
+    LIGHT_TRIANGLE = 0,
+    LIGHT_SPHERE = 1,
+};
+
+// First-fit suballocator over element ranges of a pool buffer, grows when nothing fits
+struct PoolAllocator
+{
+    int capacity = 0;
+
+    int Alloc(int count);
+    void Free(int offset, int count);
+
+private:
+    std::vector<glm::ivec2> freeRanges; // x = offset, y = count, sorted by offset
+};
+
+// Where a mesh lives in the pool buffers, node and primitive indices inside the mesh BVH are
+// local and get these offsets added during traversal. Box and disc indices are never offset,
+// those only exist in the scene's own standalone geometry.
+struct MeshRecord
+{
+    int rootIndex = -1; // Offset of the mesh nodes, -1 for a removed or empty mesh
+    int primRefOffset = 0;
+    int triOffset = 0;
+    int quadOffset = 0;
+    int leafBlockOffset = 0;
+    int flags = 0;
+};
+
+// Keep in sync with trace.glsl
+enum MeshFlags
+{
+    MESH_PAGE = 1, // Only reached through a paged mesh's page table, not traced on its own
+};
+
+// Scene-wide geometry pool, every mesh is packed into the same triangle, quad, node and
+// reference buffers so any number of meshes can be bound at once. A top-level tree over the
+// mesh roots is kept in the node buffer too, so rays skip meshes they don't come near.
+struct GeometryPool
+{
+    std::vector<PrecomputedTriangle> triangles;
+    std::vector<Quad> quads;
+    std::vector<Node> nodes;
+    std::vector<int> primRefs;
+    std::vector<uint32_t> leafBlocks;
+    std::vector<MeshRecord> records;
+    int topLevelRoot = -1; // Node offset of the tree over every traced mesh's root, -1 without meshes
+
+    int Add(const std::vector<Triangle>& tris, const std::vector<Quad>& meshQuads, const BVH& bvh);
+    void Remove(int meshIndex);
 
     void SetupSSBOs();
     void UpdateSSBOs();
+    void UpdateRecordSSBOs(int meshIndex); // Uploads only what changed for one record when the buffers are big enough
+
+    int TriangleCount(int meshIndex) const;
 
 private:
-    GLuint materialSSBO, sphereSSBO, triangleSSBO;
+    struct MeshAllocation { int numTris, numQuads, numNodes, numPrimRefs, numLeafBlocks; };
+
+    PoolAllocator triAllocator, quadAllocator, nodeAllocator, primRefAllocator, leafBlockAllocator;
+    std::vector<MeshAllocation> allocations; // What each record owns, so it can be freed
+    std::vector<int> freeRecords;
+    std::vector<int> topLevelRecords; // Records in the top-level tree, one per leaf
+    int topLevelNodes = 0;
+
+    GLuint triangleSSBO, quadSSBO, bvhSSBO, primRefSSBO, leafBlockSSBO, meshRecordSSBO;
+    size_t uploadedTris = 0, uploadedQuads = 0, uploadedNodes = 0, uploadedPrimRefs = 0, uploadedLeafBlocks = 0, uploadedRecords = 0;
+
+    void BuildTopLevel();
+    void SplitTopLevel(std::vector<Node>& topNodes, int nodeIndex, int first, int count);
 };
 
-struct Node
+// Subtree of a paged mesh, rebuilt as its own BVH so it can be moved in and out of the pool
+struct GeometryPage
 {
-    glm::vec4 boundsMin = glm::vec4(1e30f);
-    glm::vec4 boundsMax = glm::vec4(-1e30f);
-    int triIndex = 0;
-    int numTris = 0;
-    int childrenIndex = 0;
+    std::vector<Triangle> tris;
+    std::vector<Quad> quads;
+    BVH bvh;
+
+    std::streamoff fileOffset = -1; // Where the page is stored in the page file, -1 if kept in host memory
+    size_t bytes = 0; // Size in the pool while resident
+    int poolIndex = -1; // Pool record while resident
+    uint64_t lastUsedFrame = 0;
+};
+
+// Page feedback bits written by the traversal, keep in sync with trace.glsl
+enum PageFeedback
+{
+    PAGE_USED = 1,
+    PAGE_REQUESTED = 2,
+};
+
+// Out-of-core geometry. Large meshes keep a small top-level tree resident whose cut nodes link
+// to pages, rays that reach a missing page are deferred and request it through the feedback
+// buffer, and requested pages are streamed into the pool within a byte budget, evicting the
+// least recently used ones. The feedback is copied into a ring of buffers and read a few frames
+// later, once the GPU is done with it.
+struct ResidencyManager
+{
+    int pageTris = 0; // Meshes with more primitives than this are split into pages of at most this many, 0 disables paging
+    size_t budgetBytes = 256 * 1024 * 1024;
+    int maxLoadsPerFrame = 8;
+    std::string pageFilePath; // Pages are written here and dropped from host memory, empty keeps them in host memory
+
+    std::vector<GeometryPage> pages;
+    std::vector<int> pageTable; // Pool record of each page, -1 if not resident
+    bool hasQuads = false; // Any page holds quads, pages only reach the pool once they are loaded
+
+    int AddPagedMesh(GeometryPool& pool, const std::vector<Triangle>& tris, const std::vector<Quad>& quads, const BVH& bvh);
+
+    void SetupSSBOs();
+    void Update(GeometryPool& pool); // Call once per frame after the trace
+
+    // Host copy of a page, straight from pages when kept in host memory or read from the page file into scratch
+    const GeometryPage& ReadPage(int pageIndex, GeometryPage& scratch) const;
 
-    void GrowBounds(Triangle tri);
+    // Host copy for CPU queries, pages read from the page file stay cached for the next query
+    const GeometryPage& HostPage(int pageIndex) const;
+    int hostCachePages = 64;
 
 private:
-    int pad;
+    static constexpr int readbackCount = 3; // Frames the feedback may lag behind the trace
+
+    size_t residentBytes = 0;
+    uint64_t frame = 0;
+
+    GLuint pageTableSSBO, pageFeedbackSSBO;
+    GLuint readbackBuffers[readbackCount];
+    GLsync readbackFences[readbackCount] = {}; // Set while a copy is in flight
+    int currentReadback = 0;
+
+    mutable std::map<int, GeometryPage> hostCache;
+    mutable std::vector<int> hostCacheOrder; // Oldest read first
+
+    void BuildTopLevel(const BVH& bvh, const std::vector<Triangle>& tris, const std::vector<Quad>& quads, const std::vector<int>& subtreeRefs, int src, int dst, std::vector<Node>& topNodes);
+    int MakePage(const BVH& bvh, const std::vector<Triangle>& tris, const std::vector<Quad>& quads, int root);
+    void LoadPage(GeometryPool& pool, int pageIndex);
+    void EvictPage(GeometryPool& pool, int pageIndex);
+};
+
+struct Scene
+{
+    std::vector<Material> materials;
+    std::vector<Sphere> spheres;
+    std::vector<Triangle> triangles;
+    std::vector<Plane> planes;
+    std::vector<Box> boxes;
+    std::vector<Disc> discs;
+    std::vector<Quad> quads;
+
+    GeometryPool pool;
+    BVH bvh; // Standalone triangles, quads, boxes and discs, stored in the pool like a mesh
+    ResidencyManager residency;
+
+    std::vector<Light> lights; // Emissive triangles and spheres, rebuilt by UpdateSSBOs
+    float lightPower = 0.0f; // Sum of luminance times area over all lights
+
+    void SetupSSBOs();
+    void UpdateSSBOs();
+
+    void Bounds(glm::vec3& boundsMin, glm::vec3& boundsMax) const; // Everything except planes
+
+    // HAS_* defines for the trace shaders, primitive types and material features the scene doesn't use
+    // compile out. Lights are only known after SetupSSBOs.
+    std::map<std::string, int> FeatureDefines() const;
+
+private:
+    int standaloneIndex = -1;
+
+    GLuint materialSSBO, sphereSSBO, planeSSBO, boxSSBO, discSSBO, lightSSBO;
+
+    void BuildLights();
 };
 
 struct Mesh
 {
     std::vector<glm::vec4> vertices;
     std::vector<glm::ivec4> indices;
+    std::vector<glm::ivec4> quadIndices;
     std::vector<Triangle> tris;
+    std::vector<Quad> quads;
 
-    uint32_t materialIndex = 0;
+    BVH bvh;
 
-    std::vector<Node> nodes;
+    uint32_t materialIndex = 0;
+    int meshIndex = -1; // Record in Scene::pool, the resident top-level tree for a paged mesh
     
-    Mesh(const char* filePath, uint32_t materialIndex);
+    Mesh(struct Scene& scene, const char* filePath, uint32_t materialIndex);
 
 private:
     void Load(const char* filePath);
-    void GenBoundingBox();
-    void SplitNode(Node parent, int depth);
 };
\ No newline at end of file
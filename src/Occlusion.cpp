@@ -0,0 +1,250 @@
+#include "Occlusion.h"
+#include "Object.h"
+
+namespace
+{
+	struct OcclusionRay
+	{
+		glm::vec3 origin;
+		glm::vec3 direction;
+		glm::vec3 invDirection;
+		float tMax;
+	};
+
+	// Same tests as trace.glsl, only asking whether there is a hit in (0, tMax)
+	bool HitsAABB(const OcclusionRay& ray, const Node& node)
+	{
+		glm::vec3 t1 = (glm::vec3(node.boundsMin) - ray.origin) * ray.invDirection;
+		glm::vec3 t2 = (glm::vec3(node.boundsMax) - ray.origin) * ray.invDirection;
+		glm::vec3 tMin = glm::min(t1, t2);
+		glm::vec3 tMax = glm::max(t1, t2);
+
+		float tNear = glm::max(glm::max(tMin.x, tMin.y), tMin.z);
+		float tFar = glm::min(glm::min(tMax.x, tMax.y), tMax.z);
+		return tFar >= tNear && tFar >= 0.0f && tNear < ray.tMax;
+	}
+
+	bool HitsTriangle(const OcclusionRay& ray, const PrecomputedTriangle& tri)
+	{
+		glm::vec3 rayCrossE2 = glm::cross(ray.direction, glm::vec3(tri.edge2));
+		float det = glm::dot(glm::vec3(tri.edge1), rayCrossE2);
+		if (det == 0.0f) return false;
+
+		float invDet = 1.0f / det;
+		glm::vec3 s = ray.origin - glm::vec3(tri.vertex);
+		float u = invDet * glm::dot(s, rayCrossE2);
+		if (u < 0.0f || u > 1.0f) return false;
+
+		glm::vec3 sCrossE1 = glm::cross(s, glm::vec3(tri.edge1));
+		float v = invDet * glm::dot(ray.direction, sCrossE1);
+		if (v < 0.0f || u + v > 1.0f) return false;
+
+		float t = invDet * glm::dot(glm::vec3(tri.edge2), sCrossE1);
+		return t > 0.0f && t < ray.tMax;
+	}
+
+	// Bilinear patch, see IntersectQuad in trace.glsl
+	bool HitsQuad(const OcclusionRay& ray, const Quad& quad)
+	{
+		glm::vec3 q00 = glm::vec3(quad.p1), q10 = glm::vec3(quad.p2), q11 = glm::vec3(quad.p3), q01 = glm::vec3(quad.p4);
+		glm::vec3 e10 = q10 - q00;
+		glm::vec3 e11 = q11 - q10;
+		glm::vec3 e00 = q01 - q00;
+		glm::vec3 qn = glm::cross(e10, q01 - q11);
+		q00 -= ray.origin;
+		q10 -= ray.origin;
+
+		float a = glm::dot(glm::cross(q00, ray.direction), e00);
+		float c = glm::dot(qn, ray.direction);
+		float b = glm::dot(glm::cross(q10, ray.direction), e11) - (a + c);
+		float det = b * b - 4.0f * a * c;
+		if (det < 0.0f) return false;
+		det = glm::sqrt(det);
+
+		float roots[2];
+		if (c == 0.0f) { roots[0] = -a / b; roots[1] = -1.0f; }
+		else { roots[0] = (-b - (b < 0.0f ? -det : det)) / 2.0f; roots[1] = a / roots[0]; roots[0] /= c; }
+
+		for (float u : roots)
+		{
+			if (u < 0.0f || u > 1.0f) continue;
+
+			glm::vec3 pa = glm::mix(q00, q10, u);
+			glm::vec3 pb = glm::mix(e00, e11, u);
+			glm::vec3 n = glm::cross(ray.direction, pb);
+			float nLen2 = glm::dot(n, n);
+			n = glm::cross(n, pa);
+			float t = glm::dot(n, pb) / nLen2;
+			float v = glm::dot(n, ray.direction);
+
+			if (v >= 0.0f && v <= nLen2 && t > 0.0f && t < ray.tMax) return true;
+		}
+		return false;
+	}
+
+	bool HitsBox(const OcclusionRay& ray, const Box& box)
+	{
+		glm::vec3 t1 = (glm::vec3(box.boundsMin) - ray.origin) * ray.invDirection;
+		glm::vec3 t2 = (glm::vec3(box.boundsMax) - ray.origin) * ray.invDirection;
+		glm::vec3 tMin = glm::min(t1, t2);
+		glm::vec3 tMax = glm::max(t1, t2);
+
+		float tNear = glm::max(glm::max(tMin.x, tMin.y), tMin.z);
+		float tFar = glm::min(glm::min(tMax.x, tMax.y), tMax.z);
+		if (tFar < tNear || tFar <= 0.0f) return false;
+
+		float t = tNear > 0.0f ? tNear : tFar;
+		return t < ray.tMax;
+	}
+
+	bool HitsDisc(const OcclusionRay& ray, const Disc& disc)
+	{
+		float denom = glm::dot(disc.normal, ray.direction);
+		if (denom == 0.0f) return false;
+
+		float t = glm::dot(disc.position - ray.origin, disc.normal) / denom;
+		if (t <= 0.0f || t >= ray.tMax) return false;
+
+		glm::vec3 offset = ray.origin + ray.direction * t - disc.position;
+		return glm::dot(offset, offset) <= disc.radius * disc.radius;
+	}
+
+	bool HitsSphere(const OcclusionRay& ray, const Sphere& sphere)
+	{
+		glm::vec3 oc = ray.origin - sphere.position;
+		float a = glm::dot(ray.direction, ray.direction);
+		float halfB = glm::dot(oc, ray.direction);
+		float c = glm::dot(oc, oc) - sphere.radius * sphere.radius;
+
+		float discriminant = halfB * halfB - a * c;
+		if (discriminant < 0.0f) return false;
+
+		float sqrtDisc = glm::sqrt(discriminant);
+		float t0 = (-halfB - sqrtDisc) / a;
+		float t1 = (-halfB + sqrtDisc) / a;
+
+		float t = t0 > 0.0f ? t0 : t1;
+		return t > 0.0f && t < ray.tMax;
+	}
+
+	bool HitsPlane(const OcclusionRay& ray, const Plane& plane)
+	{
+		float denom = glm::dot(plane.normal, ray.direction);
+		if (denom == 0.0f) return false;
+
+		float t = (plane.offset - glm::dot(plane.normal, ray.origin)) / denom;
+		return t > 0.0f && t < ray.tMax;
+	}
+
+	bool OccludedRecord(const OcclusionRay& ray, const Scene& scene, int recordIndex);
+
+	// Indices are local to the given arrays, like a mesh in the pool. Compressed leaves still have
+	// their primitive references, so the full-precision triangles are tested.
+	template<typename TriangleT>
+	bool OccludedBVH(const OcclusionRay& ray, const Scene& scene, const Node* nodes, const int* primRefs, const TriangleT* tris, const Quad* quads)
+	{
+		int nodeStack[64];
+		int stackIndex = 0;
+		nodeStack[stackIndex++] = 0;
+
+		while (stackIndex > 0)
+		{
+			const Node& node = nodes[nodeStack[--stackIndex]];
+
+			if (!HitsAABB(ray, node)) continue;
+
+			if (node.numTris > 0)
+			{
+				for (int i = node.triIndex; i < node.triIndex + node.numTris; ++i)
+				{
+					int primType = primRefs[i] >> PRIM_TYPE_SHIFT;
+					int primIndex = primRefs[i] & PRIM_INDEX_MASK;
+
+					bool hit;
+					if (primType == PRIM_TRIANGLE) hit = HitsTriangle(ray, PrecomputedTriangle(tris[primIndex]));
+					else if (primType == PRIM_QUAD) hit = HitsQuad(ray, quads[primIndex]);
+					else if (primType == PRIM_BOX) hit = HitsBox(ray, scene.boxes[primIndex]);
+					else hit = HitsDisc(ray, scene.discs[primIndex]);
+
+					if (hit) return true;
+				}
+			}
+			else if (node.childrenIndex < 0)
+			{
+				int page = -node.childrenIndex - 1;
+				int record = scene.residency.pageTable[page];
+
+				if (record >= 0)
+				{
+					if (OccludedRecord(ray, scene, record)) return true;
+				}
+				else
+				{
+					const GeometryPage& host = scene.residency.HostPage(page);
+					if (OccludedBVH(ray, scene, host.bvh.nodes.data(), host.bvh.primRefs.data(), host.tris.data(), host.quads.data())) return true;
+				}
+			}
+			else
+			{
+				nodeStack[stackIndex++] = node.childrenIndex + 1;
+				nodeStack[stackIndex++] = node.childrenIndex;
+			}
+		}
+		return false;
+	}
+
+	bool OccludedRecord(const OcclusionRay& ray, const Scene& scene, int recordIndex)
+	{
+		const GeometryPool& pool = scene.pool;
+		const MeshRecord& record = pool.records[recordIndex];
+
+		return OccludedBVH(ray, scene, pool.nodes.data() + record.rootIndex, pool.primRefs.data() + record.primRefOffset,
+			pool.triangles.data() + record.triOffset, pool.quads.data() + record.quadOffset);
+	}
+}
+
+bool Occluded(const Scene& scene, glm::vec3 origin, glm::vec3 direction, float tMin, float tMax)
+{
+	OcclusionRay ray;
+	ray.origin = origin + direction * tMin;
+	ray.direction = direction;
+	ray.invDirection = 1.0f / direction;
+	ray.tMax = tMax - tMin;
+
+	for (const Plane& plane : scene.planes)
+	{
+		if (HitsPlane(ray, plane)) return true;
+	}
+
+	for (const Sphere& sphere : scene.spheres)
+	{
+		if (HitsSphere(ray, sphere)) return true;
+	}
+
+	// Meshes through the same top-level tree as the GPU, built by GeometryPool::UpdateSSBOs
+	const GeometryPool& pool = scene.pool;
+	if (pool.topLevelRoot < 0) return false;
+
+	int nodeStack[64];
+	int stackIndex = 0;
+	nodeStack[stackIndex++] = pool.topLevelRoot;
+
+	while (stackIndex > 0)
+	{
+		const Node& node = pool.nodes[nodeStack[--stackIndex]];
+
+		if (!HitsAABB(ray, node)) continue;
+
+		if (node.numTris > 0)
+		{
+			if (OccludedRecord(ray, scene, node.triIndex)) return true;
+		}
+		else
+		{
+			nodeStack[stackIndex++] = pool.topLevelRoot + node.childrenIndex + 1;
+			nodeStack[stackIndex++] = pool.topLevelRoot + node.childrenIndex;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <glm.hpp>
+
+struct Scene;
+
+// Any-hit query on the CPU against what the GPU traces: the geometry pool, planes and spheres.
+// True as soon as anything is hit between tMin and tMax along the ray. Pages that aren't
+// resident come from the residency manager's host copy, see ResidencyManager::HostPage.
+bool Occluded(const Scene& scene, glm::vec3 origin, glm::vec3 direction, float tMin, float tMax);
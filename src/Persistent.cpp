@@ -0,0 +1,99 @@
+#include "Persistent.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	// Interleaves the bits of x and y, x in the even bits
+	uint32_t MortonCode(uint32_t x, uint32_t y)
+	{
+		auto spread = [](uint32_t v)
+		{
+			v &= 0x0000FFFF;
+			v = (v | (v << 8)) & 0x00FF00FF;
+			v = (v | (v << 4)) & 0x0F0F0F0F;
+			v = (v | (v << 2)) & 0x33333333;
+			v = (v | (v << 1)) & 0x55555555;
+			return v;
+		};
+		return spread(x) | (spread(y) << 1);
+	}
+}
+
+PersistentPipeline::PersistentPipeline(int width, int height, ComputeVariantCache& cache, const ShaderDefines& defines)
+{
+	SetVariant(cache, defines);
+
+	int tilesX = (width + 7) / 8;
+	int tilesY = (height + 7) / 8;
+
+	std::vector<uint32_t> tileOrder;
+	tileOrder.reserve(tilesX * tilesY);
+	for (int y = 0; y < tilesY; ++y)
+	{
+		for (int x = 0; x < tilesX; ++x)
+		{
+			tileOrder.push_back(x | (y << 16));
+		}
+	}
+	std::sort(tileOrder.begin(), tileOrder.end(), [](uint32_t a, uint32_t b)
+		{
+			return MortonCode(a & 0xFFFF, a >> 16) < MortonCode(b & 0xFFFF, b >> 16);
+		});
+
+	// An 8x8 group is two warps, fill every warp slot of every SM when the driver tells us how many there are
+	if (GLEW_NV_shader_thread_group)
+	{
+		GLint smCount = 0, warpsPerSM = 0;
+		glGetIntegerv(GL_SM_COUNT_NV, &smCount);
+		glGetIntegerv(GL_WARPS_PER_SM_NV, &warpsPerSM);
+		groupCount = smCount * warpsPerSM / 2;
+	}
+	if (groupCount <= 0) groupCount = 1024;
+	groupCount = std::min(groupCount, (int)tileOrder.size());
+
+	std::cout << "Persistent threads: " << groupCount << " groups for " << tileOrder.size() << " tiles\n";
+
+	glGenBuffers(1, &tileOrderSSBO);
+	glGenBuffers(1, &tileCounterSSBO);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileOrderSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, tileOrder.size() * sizeof(uint32_t), tileOrder.data(), GL_STATIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, tileOrderSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileCounterSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t), NULL, GL_DYNAMIC_COPY);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 19, tileCounterSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+PersistentPipeline::~PersistentPipeline()
+{
+	glDeleteBuffers(1, &tileOrderSSBO);
+	glDeleteBuffers(1, &tileCounterSSBO);
+}
+
+void PersistentPipeline::SetVariant(ComputeVariantCache& cache, const ShaderDefines& defines)
+{
+	program = &cache.Get("res/shaders/rt_persistent.comp", defines);
+}
+
+void PersistentPipeline::Render(int currAccumPass, int firstSample, int samplesPerPass, Camera& camera)
+{
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileCounterSSBO);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	program->Use();
+	program->SetUniform1i("currAccumPass", currAccumPass);
+	program->SetUniform1i("firstSample", firstSample);
+	program->SetUniform1i("samplesPerPass", samplesPerPass);
+	program->SetUniformCamera(camera);
+	glDispatchCompute(groupCount, 1, 1);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT); // nextTile is cleared at the start of the next pass
+	program->Unuse();
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include "Shader.h"
+
+// Persistent-threads megakernel: launches only groupCount groups of 8x8 which pull 8x8 pixel
+// tiles from an atomic counter, in Morton order so neighbouring groups trace neighbouring tiles
+struct PersistentPipeline
+{
+    int groupCount = 0; // Groups kept resident, estimated from the GPU in the constructor
+
+    PersistentPipeline(int width, int height, ComputeVariantCache& cache, const ShaderDefines& defines);
+    ~PersistentPipeline();
+
+    void Render(int currAccumPass, int firstSample, int samplesPerPass, Camera& camera);
+    void SetVariant(ComputeVariantCache& cache, const ShaderDefines& defines);
+
+private:
+    ComputeProgram* program = nullptr; // Owned by the variant cache
+
+    GLuint tileOrderSSBO, tileCounterSSBO;
+};
@@ -4,6 +4,8 @@ namespace Renderer
 {
     GLuint vao, vbo, ebo;
     GLuint accumTexID, rtFboID, screenDepthRbID;
+    GLuint momentsTexID;
+    GLuint pathStatsSSBO;
 
     GLFWwindow* window;
     GLFWmonitor* monitor;
@@ -125,7 +127,12 @@ int Renderer::Init(int width, int height)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, screenWidth, screenHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-    glBindImageTexture(0, accumTexID, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    glBindImageTexture(0, accumTexID, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+    // Second luminance moment next to the accumulated mean, for per-pixel variance
+    momentsTexID = CreateTexture(screenWidth, screenHeight, GL_R32F);
+    glBindImageTexture(1, momentsTexID, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+    glBindTexture(GL_TEXTURE_2D, accumTexID);
 
     glGenRenderbuffers(1, &screenDepthRbID);
     glBindRenderbuffer(GL_RENDERBUFFER, screenDepthRbID);
@@ -137,6 +144,41 @@ int Renderer::Init(int width, int height)
     glBindTexture(GL_TEXTURE_2D, 0);
     glBindRenderbuffer(GL_RENDERBUFFER, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Finished paths and their total bounces, counted by every render mode
+    const GLuint zeroStats[2] = { 0, 0 };
+    glGenBuffers(1, &pathStatsSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, pathStatsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zeroStats), zeroStats, GL_DYNAMIC_READ);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, pathStatsSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+float Renderer::ReadAveragePathLength()
+{
+    GLuint stats[2];
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, pathStatsSSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(stats), stats);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    return stats[0] ? (float)stats[1] / stats[0] : 0.0f;
+}
+
+GLuint Renderer::CreateTexture(int width, int height, GLenum internalFormat)
+{
+    GLuint texID;
+    glGenTextures(1, &texID);
+    glBindTexture(GL_TEXTURE_2D, texID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texID;
 }
 
 void Renderer::MouseCallback(GLFWwindow* window, double xpos, double ypos)
@@ -31,6 +31,8 @@ namespace Renderer
 {
     extern GLuint vao, vbo, ebo;
     extern GLuint accumTexID, rtFboID, screenDepthRbID;
+    extern GLuint momentsTexID; // Running mean of squared luminance per pixel, image unit 1
+    extern GLuint pathStatsSSBO;
 
     extern GLFWwindow* window;
     extern GLFWmonitor* monitor;
@@ -42,4 +44,8 @@ namespace Renderer
 
     int Init(int width, int height);
     void MouseCallback(GLFWwindow* window, double xpos, double ypos);
+    float ReadAveragePathLength(); // Bounces per path since the last call, resets the counters
+
+    // Immutable single-level 2D texture with nearest filtering and clamped edges, for the compute images
+    GLuint CreateTexture(int width, int height, GLenum internalFormat);
 }
\ No newline at end of file
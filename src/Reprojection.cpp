@@ -0,0 +1,46 @@
+#include "Reprojection.h"
+#include "Renderer.h"
+
+Reprojector::Reprojector(int width, int height, ComputeVariantCache& cache, const ShaderDefines& defines) : width(width), height(height)
+{
+	SetVariant(cache, defines);
+
+	historyTexID = Renderer::CreateTexture(width, height, GL_RGBA32F);
+	historyMomentsTexID = Renderer::CreateTexture(width, height, GL_R32F);
+}
+
+Reprojector::~Reprojector()
+{
+	glDeleteTextures(1, &historyTexID);
+	glDeleteTextures(1, &historyMomentsTexID);
+}
+
+void Reprojector::SetVariant(ComputeVariantCache& cache, const ShaderDefines& defines)
+{
+	program = &cache.Get("res/shaders/reproject.comp", defines);
+}
+
+void Reprojector::Reproject(GLuint accumTexID, GLuint momentsTexID, FirstHitAOVs& aovs, Camera& prevCamera, Camera& camera)
+{
+	// Depth of the view the accumulation was rendered from, then of the new one
+	aovs.Update(prevCamera);
+	aovs.Advance(camera);
+	aovs.Bind();
+
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+	glCopyImageSubData(accumTexID, GL_TEXTURE_2D, 0, 0, 0, 0, historyTexID, GL_TEXTURE_2D, 0, 0, 0, 0, width, height, 1);
+	glCopyImageSubData(momentsTexID, GL_TEXTURE_2D, 0, 0, 0, 0, historyMomentsTexID, GL_TEXTURE_2D, 0, 0, 0, 0, width, height, 1);
+
+	glBindImageTexture(7, historyTexID, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+	glBindImageTexture(8, historyMomentsTexID, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+
+	program->Use();
+	program->SetUniformCamera(camera);
+	program->SetUniform3f("prevCamPosition", prevCamera.position);
+	glUniformMatrix4fv(glGetUniformLocation(program->ID, "prevInverseView"), 1, GL_FALSE, &prevCamera.inverseView[0][0]);
+	program->SetUniform1f("maxHistory", maxHistory);
+	program->SetUniform1f("depthTolerance", depthTolerance);
+	glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+	glUseProgram(0);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include "Shader.h"
+#include "Camera.h"
+#include "AOV.h"
+
+// Temporal reprojection: when the camera moves the accumulation is warped into the new view with
+// the first-hit depth of both views, instead of starting again from one sample per pixel.
+// Disoccluded pixels start over, the rest keep at most maxHistory samples.
+struct Reprojector
+{
+    bool enabled = true;
+    float maxHistory = 32.0f; // History never outweighs this many samples, so stale shading fades
+    float depthTolerance = 0.05f; // Relative depth difference that still counts as the same surface
+
+    Reprojector(int width, int height, ComputeVariantCache& cache, const ShaderDefines& defines);
+    ~Reprojector();
+
+    // Rewrites the accumulation and moments images for camera, prevCamera is the view they hold
+    void Reproject(GLuint accumTexID, GLuint momentsTexID, FirstHitAOVs& aovs, Camera& prevCamera, Camera& camera);
+    void SetVariant(ComputeVariantCache& cache, const ShaderDefines& defines);
+
+private:
+    ComputeProgram* program = nullptr; // Owned by the variant cache
+
+    GLuint historyTexID, historyMomentsTexID; // Copies of the accumulation the pass reads from
+    int width, height;
+};
@@ -1,37 +1,159 @@
 #include "Shader.h"
 
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	// Linked program binaries by key hash, a missing directory only means nothing gets cached
+	const std::string binaryCacheDirectory = "res/shader_cache/";
+
+	// Reads a shader, #include "file" lines are replaced by that file, relative to the including one
+	std::string LoadSource(const std::string& filepath)
+	{
+		std::string directory = filepath.substr(0, filepath.find_last_of("/\\") + 1);
+
+		std::string outString, line;
+		std::ifstream inFile(filepath);
+
+		while (getline(inFile, line))
+		{
+			if (line.compare(0, 8, "#include") == 0)
+			{
+				size_t first = line.find('"');
+				size_t last = line.find('"', first + 1);
+				outString += LoadSource(directory + line.substr(first + 1, last - first - 1));
+				continue;
+			}
+			outString += line + "\n";
+		}
+		inFile.close();
+
+		return outString;
+	}
+
+	// Defines go after the #version line, which has to stay first
+	void InjectDefines(std::string& source, const ShaderDefines& defines)
+	{
+		if (defines.empty()) return;
+
+		std::string defineLines;
+		for (const auto& define : defines) defineLines += "#define " + define.first + " " + std::to_string(define.second) + "\n";
+
+		size_t version = source.find("#version");
+		size_t insertAt = version == std::string::npos ? 0 : source.find('\n', version) + 1;
+		source.insert(insertAt, defineLines);
+	}
+
+	// FNV-1a
+	uint64_t HashString(const std::string& s)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (unsigned char c : s)
+		{
+			hash ^= c;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// Cache file for a program built from these sources. The sources already carry the injected
+	// defines and included files, and the driver strings are hashed too so a driver update
+	// invalidates every binary.
+	std::string BinaryCachePath(std::string key)
+	{
+		for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) key += reinterpret_cast<const char*>(glGetString(name));
+
+		char hex[17];
+		snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)HashString(key));
+		return binaryCacheDirectory + hex + ".bin";
+	}
+
+	bool ProgramBinariesSupported()
+	{
+		GLint formatCount = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+		return formatCount > 0;
+	}
+
+	// Linked program from the cache file, 0 when there is none or the driver rejects it as stale
+	GLuint LoadProgramBinary(const std::string& path)
+	{
+		if (!ProgramBinariesSupported()) return 0;
+
+		std::ifstream file(path, std::ios::binary);
+		if (!file) return 0;
+
+		GLenum format = 0;
+		GLint length = 0;
+		file.read(reinterpret_cast<char*>(&format), sizeof(format));
+		file.read(reinterpret_cast<char*>(&length), sizeof(length));
+		if (!file || length <= 0) return 0;
+
+		std::vector<char> binary(length);
+		file.read(binary.data(), length);
+		if (!file) return 0;
+
+		GLuint program = glCreateProgram();
+		glProgramBinary(program, format, binary.data(), length);
+
+		GLint linked = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (!linked)
+		{
+			glDeleteProgram(program);
+			return 0;
+		}
+		return program;
+	}
+
+	// Program has to be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+	void SaveProgramBinary(GLuint program, const std::string& path)
+	{
+		if (!ProgramBinariesSupported()) return;
+
+		GLint linked = GL_FALSE, length = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (!linked || length <= 0) return;
+
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+		file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+		file.write(binary.data(), length);
+	}
+}
+
 Shader::Shader(GLenum shaderType, const char* filepath)
 {
 	ID = glCreateShader(shaderType);
 
-	std::string outString, line;
-	std::ifstream inFile(filepath);
-
-	while (getline(inFile, line)) outString += line + "\n";
-	inFile.close();
+	std::string outString = LoadSource(filepath);
 
 	const char* source = outString.c_str();
 
 	glShaderSource(ID, 1, &source, NULL);
 	glCompileShader(ID);
-
-	outString.~basic_string();
-	line.~basic_string();
 }
 
 Shader::~Shader() { glDeleteShader(ID); }
 
 
 
-ComputeProgram::ComputeProgram(const char* filepath)
+ComputeProgram::ComputeProgram(const char* filepath, const ShaderDefines& defines)
 {
-	GLuint shaderID = glCreateShader(GL_COMPUTE_SHADER);
+	std::string outString = LoadSource(filepath);
+	InjectDefines(outString, defines);
 
-	std::string outString, line;
-	std::ifstream inFile(filepath);
+	std::string binaryPath = BinaryCachePath(outString);
+	ID = LoadProgramBinary(binaryPath);
+	if (ID != 0) return;
 
-	while (getline(inFile, line)) outString += line + "\n";
-	inFile.close();
+	GLuint shaderID = glCreateShader(GL_COMPUTE_SHADER);
 
 	const char* source = outString.c_str();
 
@@ -40,9 +162,12 @@ ComputeProgram::ComputeProgram(const char* filepath)
 
 	ID = glCreateProgram();
 	glAttachShader(ID, shaderID);
+	glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(ID);
 
 	glDeleteShader(shaderID);
+
+	SaveProgramBinary(ID, binaryPath);
 }
 
 void ComputeProgram::Use() { glUseProgram(ID); }
@@ -56,6 +181,10 @@ void ComputeProgram::SetUniform1i(const char* uName, int i)
 {
 	glUniform1i(glGetUniformLocation(ID, uName), i);
 }
+void ComputeProgram::SetUniform2i(const char* uName, glm::ivec2 v)
+{
+	glUniform2i(glGetUniformLocation(ID, uName), v.x, v.y);
+}
 void ComputeProgram::SetUniform2f(const char* uName, glm::vec2 v)
 {
 	glUniform2f(glGetUniformLocation(ID, uName), v.x, v.y);
@@ -77,18 +206,40 @@ void ComputeProgram::SetUniformCamera(Camera& cam)
 
 ComputeProgram::~ComputeProgram() { glDeleteProgram(ID); }
 
+ComputeProgram& ComputeVariantCache::Get(const std::string& filepath, const ShaderDefines& defines)
+{
+	// std::map keeps the defines sorted, so equal sets give equal keys
+	std::string key = filepath;
+	for (const auto& define : defines) key += " " + define.first + "=" + std::to_string(define.second);
+
+	std::unique_ptr<ComputeProgram>& program = programs[key];
+	if (!program)
+	{
+		std::cout << "Loading variant " << key << "\n";
+		program = std::make_unique<ComputeProgram>(filepath.c_str(), defines);
+	}
+	return *program;
+}
+
 
 
 ShaderProgram::ShaderProgram(const char* vertexPath, const char* fragmentPath)
 {
+	std::string binaryPath = BinaryCachePath(LoadSource(vertexPath) + LoadSource(fragmentPath));
+	ID = LoadProgramBinary(binaryPath);
+	if (ID != 0) return;
+
 	Shader vertex(GL_VERTEX_SHADER, vertexPath);
 	Shader fragment(GL_FRAGMENT_SHADER, fragmentPath);
 
 	ID = glCreateProgram();
 	glAttachShader(ID, vertex.ID);
 	glAttachShader(ID, fragment.ID);
+	glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(ID);
 
+	SaveProgramBinary(ID, binaryPath);
+
 	vertex.~Shader();
 	fragment.~Shader();
 }
@@ -2,6 +2,8 @@
 
 #include <fstream>
 #include <string>
+#include <map>
+#include <memory>
 
 #include <glm.hpp>
 
@@ -17,11 +19,16 @@ struct Shader
 	~Shader();
 };
 
+// Preprocessor defines injected right after #version, name to value
+using ShaderDefines = std::map<std::string, int>;
+
+// Linked programs are cached as driver binaries in res/shader_cache, keyed by the preprocessed source
+// and the driver, so warm starts skip compiling. A stale binary is rejected by the driver and rebuilt.
 struct ComputeProgram
 {
 	GLuint ID;
 
-	ComputeProgram(const char* filepath);
+	ComputeProgram(const char* filepath, const ShaderDefines& defines = {});
 	~ComputeProgram();
 	
 	void Use();
@@ -29,6 +36,7 @@ struct ComputeProgram
 
 	void SetUniform1f(const char* uName, float f);
 	void SetUniform1i(const char* uName, int i);
+	void SetUniform2i(const char* uName, glm::ivec2 v);
 	void SetUniform2f(const char* uName, glm::vec2 v);
 	void SetUniform3f(const char* uName, glm::vec3 v);
 	void SetUniform4f(const char* uName, glm::vec4 v);
@@ -36,6 +44,15 @@ struct ComputeProgram
 	void SetUniformCamera(Camera& cam);
 };
 
+// Compiled compute variants by source path and defines, switching back to a variant doesn't recompile it
+struct ComputeVariantCache
+{
+	ComputeProgram& Get(const std::string& filepath, const ShaderDefines& defines);
+
+private:
+	std::map<std::string, std::unique_ptr<ComputeProgram>> programs;
+};
+
 struct ShaderProgram
 {
 	GLuint ID;
@@ -0,0 +1,92 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+
+TileScheduler::TileScheduler(int width, int height, glm::ivec2 workgroupSize, int tileSize) : workgroupSize(workgroupSize)
+{
+	// Whole workgroups per tile, so only tiles on the right and bottom edge are partial
+	tileExtent = glm::max(glm::ivec2(tileSize) / workgroupSize, glm::ivec2(1)) * workgroupSize;
+
+	SetRenderSize(width, height);
+
+	glGenQueries(queryCount, queries);
+}
+
+TileScheduler::~TileScheduler()
+{
+	glDeleteQueries(queryCount, queries);
+}
+
+void TileScheduler::ReadTimings()
+{
+	for (int i = 0; i < queryCount; ++i)
+	{
+		if (queryTileSamples[i] == 0) continue;
+
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) continue;
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+		float measured = elapsed / 1e6f / queryTileSamples[i];
+		msPerTileSample = msPerTileSample == 0.0f ? measured : glm::mix(msPerTileSample, measured, 0.25f);
+		queryTileSamples[i] = 0;
+	}
+}
+
+bool TileScheduler::Dispatch(ComputeProgram& program, int samplesPerPass)
+{
+	ReadTimings();
+
+	int tileCount = tilesX * tilesY;
+
+	// A single tile until the first timing arrives, and always at least one so the pass progresses
+	int tiles = 1;
+	if (msPerTileSample > 0.0f) tiles = std::max(1, (int)(budgetMs / (msPerTileSample * samplesPerPass)));
+	tiles = std::min(tiles, tileCount - nextTile);
+
+	// All queries still in flight means the GPU is behind, this batch just goes untimed
+	bool timed = queryTileSamples[currentQuery] == 0;
+	if (timed) glBeginQuery(GL_TIME_ELAPSED, queries[currentQuery]);
+
+	for (int i = 0; i < tiles; ++i, ++nextTile)
+	{
+		glm::ivec2 offset = glm::ivec2(nextTile % tilesX, nextTile / tilesX) * tileExtent;
+		glm::ivec2 size = glm::min(tileExtent, glm::ivec2(width, height) - offset);
+
+		program.SetUniform2i("tileOffset", offset);
+		glDispatchCompute((size.x + workgroupSize.x - 1) / workgroupSize.x, (size.y + workgroupSize.y - 1) / workgroupSize.y, 1);
+	}
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+	if (timed)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		queryTileSamples[currentQuery] = tiles * samplesPerPass;
+		currentQuery = (currentQuery + 1) % queryCount;
+	}
+
+	if (nextTile < tileCount) return false;
+	nextTile = 0;
+	return true;
+}
+
+void TileScheduler::Restart()
+{
+	nextTile = 0;
+}
+
+void TileScheduler::SetRenderSize(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	tilesX = (width + tileExtent.x - 1) / tileExtent.x;
+	tilesY = (height + tileExtent.y - 1) / tileExtent.y;
+	nextTile = 0;
+}
+
+float TileScheduler::PassTimeMs(int samplesPerPass) const
+{
+	return msPerTileSample * tilesX * tilesY * samplesPerPass;
+}
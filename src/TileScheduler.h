@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include "Shader.h"
+
+// Splits a megakernel pass into screen tiles and submits only as many per frame as fit budgetMs of
+// GPU time, so a heavy pass is spread over several frames instead of one long dispatch that
+// freezes input or trips the driver watchdog. The cost of a tile comes from timer queries of
+// earlier frames, which are only read once the GPU has finished them.
+struct TileScheduler
+{
+    float budgetMs = 12.0f;
+
+    TileScheduler(int width, int height, glm::ivec2 workgroupSize, int tileSize = 128);
+    ~TileScheduler();
+
+    // Dispatches the next tiles of the current pass, program must be in use with its other uniforms
+    // set. True when this finished the pass, the next call starts a new one.
+    bool Dispatch(ComputeProgram& program, int samplesPerPass);
+    void Restart(); // Drops what's left of the current pass
+    void SetRenderSize(int width, int height); // Tiles only cover this much of the image from now on, restarts the pass
+    bool InPass() const { return nextTile > 0; }
+
+    float PassTimeMs(int samplesPerPass) const; // Estimated GPU time of a whole pass, 0 until measured
+
+private:
+    static constexpr int queryCount = 4; // Frames a timing result may lag behind
+
+    int width, height;
+    glm::ivec2 workgroupSize, tileExtent;
+    int tilesX, tilesY;
+    int nextTile = 0;
+
+    float msPerTileSample = 0.0f; // Smoothed GPU time of one tile at one sample per pixel, 0 until measured
+
+    GLuint queries[queryCount];
+    int queryTileSamples[queryCount] = {}; // Tiles times samples a query covers, 0 when it has no pending result
+    int currentQuery = 0;
+
+    void ReadTimings();
+};
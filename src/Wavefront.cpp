@@ -0,0 +1,225 @@
+#include "Wavefront.h"
+
+#include <iostream>
+
+namespace
+{
+	// Nanoseconds between two timestamp queries, waits on the GPU so it's only used while timing
+	GLuint64 QueryElapsed(GLuint startQuery, GLuint endQuery)
+	{
+		GLuint64 start, end;
+		glGetQueryObjectui64v(startQuery, GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(endQuery, GL_QUERY_RESULT, &end);
+		return end - start;
+	}
+}
+
+WavefrontPipeline::WavefrontPipeline(int width, int height, ComputeVariantCache& cache, const ShaderDefines& defines) : width(width), height(height)
+{
+	int pathCount = width * height;
+
+	glGenBuffers(1, &pathSSBO);
+	glGenBuffers(1, &hitSSBO);
+	glGenBuffers(1, &queueSSBO);
+	glGenBuffers(1, &counterSSBO);
+	glGenBuffers(1, &sortBinSSBO);
+	glGenQueries(4, timestampQueries);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, pathSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, pathCount * sizeof(PathState), NULL, GL_DYNAMIC_COPY);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, pathSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, hitSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, pathCount * sizeof(PathHit), NULL, GL_DYNAMIC_COPY);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, hitSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, queueSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * pathCount * sizeof(uint32_t), NULL, GL_DYNAMIC_COPY);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, queueSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Two queue lengths, the secondary ray count, padding, then the indirect dispatch arguments at byte offset 16
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 8 * sizeof(uint32_t), NULL, GL_DYNAMIC_COPY);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, counterSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Bin counts and offsets
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, sortBinSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * sortBins * sizeof(uint32_t), NULL, GL_DYNAMIC_COPY);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 20, sortBinSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	SetVariant(cache, defines);
+}
+
+WavefrontPipeline::~WavefrontPipeline()
+{
+	glDeleteBuffers(1, &pathSSBO);
+	glDeleteBuffers(1, &hitSSBO);
+	glDeleteBuffers(1, &queueSSBO);
+	glDeleteBuffers(1, &counterSSBO);
+	glDeleteBuffers(1, &sortBinSSBO);
+	glDeleteQueries(4, timestampQueries);
+}
+
+void WavefrontPipeline::SetVariant(ComputeVariantCache& cache, const ShaderDefines& defines)
+{
+	generateProgram = &cache.Get("res/shaders/wf_generate.comp", defines);
+	dispatchProgram = &cache.Get("res/shaders/wf_dispatch.comp", defines);
+	extendProgram = &cache.Get("res/shaders/wf_extend.comp", defines);
+	shadeProgram = &cache.Get("res/shaders/wf_shade.comp", defines);
+	accumulateProgram = &cache.Get("res/shaders/wf_accumulate.comp", defines);
+	sortCountProgram = &cache.Get("res/shaders/wf_sort_count.comp", defines);
+	sortScanProgram = &cache.Get("res/shaders/wf_sort_scan.comp", defines);
+	sortScatterProgram = &cache.Get("res/shaders/wf_sort_scatter.comp", defines);
+
+	auto bounces = defines.find("MAX_BOUNCES");
+	if (bounces != defines.end()) maxBounces = bounces->second;
+
+	// Uniforms are per program, a variant fetched for the first time has none of them set
+	for (ComputeProgram* program : { generateProgram, dispatchProgram, extendProgram, shadeProgram, accumulateProgram, sortCountProgram, sortScanProgram, sortScatterProgram })
+	{
+		program->Use();
+		program->SetUniform1i("pathCount", width * height);
+	}
+	glUseProgram(0);
+
+	SetSortBounds(sortBoundsMin, sortBoundsMax);
+}
+
+void WavefrontPipeline::SetSortBounds(glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+	sortBoundsMin = boundsMin;
+	sortBoundsMax = boundsMax;
+
+	for (ComputeProgram* program : { sortCountProgram, sortScatterProgram })
+	{
+		program->Use();
+		program->SetUniform3f("sortBoundsMin", boundsMin);
+		program->SetUniform3f("sortBoundsMax", boundsMax);
+	}
+	glUseProgram(0);
+}
+
+// Counting sort of the current queue into its bins. The scatter writes straight into the spare
+// queue, which the dispatch pass has just emptied, so the sorted paths are never copied back.
+// Returns the queue that holds them, the other one is emptied for shading to fill.
+int WavefrontPipeline::SortQueue(int currentQueue)
+{
+	const GLintptr dispatchOffset = 4 * sizeof(uint32_t);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, sortBinSSBO);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	sortCountProgram->Use();
+	sortCountProgram->SetUniform1i("currentQueue", currentQueue);
+	glDispatchComputeIndirect(dispatchOffset);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	sortScanProgram->Use();
+	sortScanProgram->SetUniform1i("currentQueue", currentQueue);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	sortScatterProgram->Use();
+	sortScatterProgram->SetUniform1i("currentQueue", currentQueue);
+	glDispatchComputeIndirect(dispatchOffset);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterSSBO);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, currentQueue * sizeof(uint32_t), sizeof(uint32_t), GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	return 1 - currentQueue;
+}
+
+void WavefrontPipeline::Render(int currAccumPass, int firstSample, Camera& camera)
+{
+	const GLintptr dispatchOffset = 4 * sizeof(uint32_t);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterSSBO);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	generateProgram->Use();
+	generateProgram->SetUniform1i("currAccumPass", currAccumPass);
+	generateProgram->SetUniform1i("firstSample", firstSample);
+	generateProgram->SetUniformCamera(camera);
+	glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// Each bounce only dispatches as many groups as there are paths left in the current queue
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, counterSSBO);
+	int currentQueue = 0;
+	for (int bounce = 0; bounce < maxBounces; ++bounce, currentQueue = 1 - currentQueue)
+	{
+		dispatchProgram->Use();
+		dispatchProgram->SetUniform1i("currentQueue", currentQueue);
+		dispatchProgram->SetUniform1i("currentBounce", bounce);
+		glDispatchCompute(1, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+		// Camera rays are coherent already, only secondary rays are sorted and timed
+		bool secondary = bounce > 0;
+
+		if (secondary && sortRays)
+		{
+			if (timing) glQueryCounter(timestampQueries[2], GL_TIMESTAMP);
+			currentQueue = SortQueue(currentQueue);
+			if (timing)
+			{
+				glQueryCounter(timestampQueries[3], GL_TIMESTAMP);
+				sortTime += QueryElapsed(timestampQueries[2], timestampQueries[3]);
+			}
+		}
+
+		if (timing && secondary) glQueryCounter(timestampQueries[0], GL_TIMESTAMP);
+		extendProgram->Use();
+		extendProgram->SetUniform1i("currentQueue", currentQueue);
+		glDispatchComputeIndirect(dispatchOffset);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		if (timing && secondary)
+		{
+			glQueryCounter(timestampQueries[1], GL_TIMESTAMP);
+			extendTime += QueryElapsed(timestampQueries[0], timestampQueries[1]);
+		}
+
+		shadeProgram->Use();
+		shadeProgram->SetUniform1i("currentQueue", currentQueue);
+		shadeProgram->SetUniform1i("currAccumPass", currAccumPass);
+		shadeProgram->SetUniform1i("firstSample", firstSample);
+		glDispatchComputeIndirect(dispatchOffset);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+	accumulateProgram->Use();
+	accumulateProgram->SetUniform1i("currAccumPass", currAccumPass);
+	glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT); // The counters are cleared at the start of the next pass
+	glUseProgram(0);
+
+	if (!timing || maxBounces < 2) return;
+
+	uint32_t frameSecondaryRays = 0;
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterSSBO);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(uint32_t), sizeof(uint32_t), &frameSecondaryRays);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	secondaryRays += frameSecondaryRays;
+
+	if (++timedFrames < statsInterval) return;
+
+	std::cout << "Wavefront, " << (sortRays ? "sorted" : "unsorted") << " secondary rays: "
+		<< (secondaryRays ? (double)extendTime / secondaryRays : 0.0) << " ns traversal per ray, "
+		<< (double)sortTime / timedFrames * 1e-6 << " ms sorting per frame, "
+		<< secondaryRays / timedFrames << " rays per frame\n";
+
+	extendTime = sortTime = secondaryRays = 0;
+	timedFrames = 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include "Shader.h"
+
+// Keep in sync with res/shaders/wavefront.glsl
+struct PathState
+{
+    glm::vec3 origin = glm::vec3(0);
+    uint32_t rngState = 0;
+    glm::vec3 direction = glm::vec3(0);
+    int bounces = 0;
+    glm::vec3 rayColor = glm::vec3(1);
+    uint32_t deferred = 0;
+private:
+    glm::vec3 pad0;
+public:
+    float bsdfPdf = 0.0f;
+    glm::vec3 incomingLight = glm::vec3(0);
+private:
+    float pad1;
+};
+
+// HitRecord in trace.glsl
+struct PathHit
+{
+    float t = 0.0f;
+    int primType = -1;
+    int primIndex = 0;
+private:
+    int pad;
+public:
+    glm::vec2 uv = glm::vec2(0);
+};
+
+// Wavefront path tracer: ray generation, extension (traversal), shading and accumulation run as
+// separate passes. Paths are handed over through two ray queues, and a one-thread pass turns the
+// current queue length into the indirect dispatch size of the next extension and shading passes.
+struct WavefrontPipeline
+{
+    int maxBounces = 8; // Bounce passes per frame, MAX_BOUNCES of the current variant
+    bool sortRays = false; // Bin secondary rays by direction octant and origin before each extension
+    bool timing = false; // Time extension and sorting with GPU timestamps, printed every statsInterval frames
+    int statsInterval = 100;
+
+    WavefrontPipeline(int width, int height, ComputeVariantCache& cache, const ShaderDefines& defines);
+    ~WavefrontPipeline();
+
+    void Render(int currAccumPass, int firstSample, Camera& camera); // One sample per pixel
+    void SetVariant(ComputeVariantCache& cache, const ShaderDefines& defines); // Switches every pass to the programs built with these defines
+    void SetSortBounds(glm::vec3 boundsMin, glm::vec3 boundsMax); // Volume the origin Morton codes are quantized in
+
+private:
+    static constexpr int sortBins = 4096; // SORT_BINS in wavefront.glsl
+
+    // Owned by the variant cache
+    ComputeProgram *generateProgram = nullptr, *dispatchProgram = nullptr, *extendProgram = nullptr, *shadeProgram = nullptr, *accumulateProgram = nullptr;
+    ComputeProgram *sortCountProgram = nullptr, *sortScanProgram = nullptr, *sortScatterProgram = nullptr;
+
+    glm::vec3 sortBoundsMin = glm::vec3(0), sortBoundsMax = glm::vec3(1); // Kept to set them again on a new variant
+
+    GLuint pathSSBO, hitSSBO, queueSSBO, counterSSBO, sortBinSSBO;
+    int width, height;
+
+    GLuint timestampQueries[4]; // Secondary extension start / end, sort start / end
+    GLuint64 extendTime = 0, sortTime = 0, secondaryRays = 0;
+    int timedFrames = 0;
+
+    int SortQueue(int currentQueue);
+};
@@ -0,0 +1,100 @@
+#include "Workgroup.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	const glm::ivec2 candidateShapes[] = { glm::ivec2(8, 8), glm::ivec2(16, 16), glm::ivec2(32, 2), glm::ivec2(64, 1) };
+}
+
+glm::ivec2 WorkgroupTuner::Tune(ComputeVariantCache& cache, const ShaderDefines& defines, int width, int height, Camera& camera)
+{
+	std::string device = std::string(reinterpret_cast<const char*>(glGetString(GL_RENDERER))) + " " + reinterpret_cast<const char*>(glGetString(GL_VERSION));
+
+	glm::ivec2 best = candidateShapes[0];
+	if (Load(device, best))
+	{
+		std::cout << "Workgroup shape " << best.x << "x" << best.y << " (cached)\n";
+		return best;
+	}
+
+	GLint maxInvocations = 0;
+	glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+
+	GLuint query;
+	glGenQueries(1, &query);
+
+	GLuint64 bestTime = ~GLuint64(0);
+	for (glm::ivec2 shape : candidateShapes)
+	{
+		if (shape.x * shape.y > maxInvocations) continue;
+
+		ShaderDefines shapeDefines = defines;
+		shapeDefines["LOCAL_SIZE_X"] = shape.x;
+		shapeDefines["LOCAL_SIZE_Y"] = shape.y;
+		ComputeProgram& program = cache.Get("res/shaders/rt.comp", shapeDefines);
+
+		program.Use();
+		program.SetUniform1i("currAccumPass", 1);
+		program.SetUniform1i("firstSample", 0);
+		program.SetUniform1i("samplesPerPass", 1);
+		program.SetUniformCamera(camera);
+
+		// The first dispatch pays for lazy driver work and is left out
+		for (int pass = 0; pass <= benchmarkPasses; ++pass)
+		{
+			if (pass == 1) glBeginQuery(GL_TIME_ELAPSED, query);
+			glDispatchCompute((width + shape.x - 1) / shape.x, (height + shape.y - 1) / shape.y, 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+		program.Unuse();
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		std::cout << "Workgroup shape " << shape.x << "x" << shape.y << ": " << elapsed / benchmarkPasses / 1e6 << " ms\n";
+
+		if (elapsed < bestTime)
+		{
+			bestTime = elapsed;
+			best = shape;
+		}
+	}
+	glDeleteQueries(1, &query);
+	glUseProgram(0);
+
+	std::cout << "Workgroup shape " << best.x << "x" << best.y << " chosen\n";
+	Save(device, best);
+	return best;
+}
+
+// One "x y device" line per device
+bool WorkgroupTuner::Load(const std::string& device, glm::ivec2& shape) const
+{
+	std::ifstream file(cachePath);
+	std::string line;
+	while (getline(file, line))
+	{
+		std::istringstream lineStream(line);
+		glm::ivec2 lineShape;
+		std::string lineDevice;
+		if (!(lineStream >> lineShape.x >> lineShape.y)) continue;
+		lineStream.get();
+		getline(lineStream, lineDevice);
+
+		if (lineDevice == device)
+		{
+			shape = lineShape;
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkgroupTuner::Save(const std::string& device, glm::ivec2 shape) const
+{
+	std::ofstream file(cachePath, std::ios::app);
+	file << shape.x << " " << shape.y << " " << device << "\n";
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <glm.hpp>
+
+#include "Shader.h"
+
+// Picks the megakernel workgroup shape by timing rt.comp on the current scene with each candidate.
+// The winner is remembered per device and driver in cachePath, so only the first start benchmarks.
+struct WorkgroupTuner
+{
+    std::string cachePath = "res/shader_cache/workgroup.txt";
+    int benchmarkPasses = 4; // Timed dispatches per candidate, after one untimed warm-up
+
+    // LOCAL_SIZE_X / LOCAL_SIZE_Y for rt.comp, compiles every candidate variant when benchmarking
+    glm::ivec2 Tune(ComputeVariantCache& cache, const ShaderDefines& defines, int width, int height, Camera& camera);
+
+private:
+    bool Load(const std::string& device, glm::ivec2& shape) const;
+    void Save(const std::string& device, glm::ivec2 shape) const;
+};